@@ -16,6 +16,27 @@ IoIn32:
     in eax, dx
     ret
 
+; void IoOut8(uint16_t addr, uint8_t data);
+global IoOut8
+IoOut8:
+    push rax            ; no_caller_saved_registers: 使うレジスタは戻す
+    push rdx
+    mov dx, di          ; dx = addr
+    mov al, sil         ; al = data
+    out dx, al
+    pop rdx
+    pop rax
+    ret
+
+; uint8_t IoIn8(uint16_t addr);
+global IoIn8
+IoIn8:
+    push rdx            ; no_caller_saved_registers: rax 以外は戻す
+    mov dx, di          ; dx = addr
+    in al, dx
+    pop rdx
+    ret
+
 ; uint16_t GetCS(void);
 global GetCS
 GetCS:
@@ -79,6 +100,165 @@ SetCR3:
     mov cr3, rdi
     ret
 
+; uint64_t GetCR3(void);
+global GetCR3
+GetCR3:
+    mov rax, cr3
+    ret
+
+; uint64_t ReadMSR(uint32_t msr);
+global ReadMSR
+ReadMSR:
+    mov ecx, edi        ; ecx = msr
+    rdmsr               ; edx:eax = MSR[ecx]
+    shl rdx, 32
+    or rax, rdx
+    ret
+
+; void WriteMSR(uint32_t msr, uint64_t value);
+global WriteMSR
+WriteMSR:
+    mov ecx, edi        ; ecx = msr
+    mov eax, esi        ; eax = value[31:0]
+    mov rdx, rsi
+    shr rdx, 32         ; edx = value[63:32]
+    wrmsr
+    ret
+
+; void WriteBackAndInvalidateCache(void);
+global WriteBackAndInvalidateCache
+WriteBackAndInvalidateCache:
+    wbinvd
+    ret
+
+; uint64_t GetCR0(void);
+global GetCR0
+GetCR0:
+    mov rax, cr0
+    ret
+
+; void SetCR0(uint64_t value);
+global SetCR0
+SetCR0:
+    mov cr0, rdi
+    ret
+
+; uint64_t GetCR4(void);
+global GetCR4
+GetCR4:
+    mov rax, cr4
+    ret
+
+; void SetCR4(uint64_t value);
+global SetCR4
+SetCR4:
+    mov cr4, rdi
+    ret
+
+; uint64_t XGetBV(uint32_t xcr);
+global XGetBV
+XGetBV:
+    mov ecx, edi        ; ecx = xcr
+    xgetbv              ; edx:eax = XCR[ecx]
+    shl rdx, 32
+    or rax, rdx
+    ret
+
+; void XSetBV(uint32_t xcr, uint64_t value);
+global XSetBV
+XSetBV:
+    mov ecx, edi        ; ecx = xcr
+    mov eax, esi        ; eax = value[31:0]
+    mov rdx, rsi
+    shr rdx, 32         ; edx = value[63:32]
+    xsetbv
+    ret
+
+; void FXSave(void* area);
+global FXSave
+FXSave:
+    fxsave64 [rdi]
+    ret
+
+; void FXRstor(const void* area);
+global FXRstor
+FXRstor:
+    fxrstor64 [rdi]
+    ret
+
+; void XSave(void* area, uint64_t mask);
+global XSave
+XSave:
+    push rax            ; no_caller_saved_registers: 使うレジスタは戻す
+    push rdx
+    mov eax, esi        ; eax = mask[31:0]
+    mov rdx, rsi
+    shr rdx, 32         ; edx = mask[63:32]
+    xsave64 [rdi]
+    pop rdx
+    pop rax
+    ret
+
+; void XRstor(const void* area, uint64_t mask);
+global XRstor
+XRstor:
+    push rax            ; no_caller_saved_registers: 使うレジスタは戻す
+    push rdx
+    mov eax, esi        ; eax = mask[31:0]
+    mov rdx, rsi
+    shr rdx, 32         ; edx = mask[63:32]
+    xrstor64 [rdi]
+    pop rdx
+    pop rax
+    ret
+
+; uint64_t ReadTSC(void);
+global ReadTSC
+ReadTSC:
+    push rdx            ; no_caller_saved_registers: rax 以外は戻す
+    rdtsc
+    shl rdx, 32
+    or rax, rdx         ; rax = edx:eax
+    pop rdx
+    ret
+
+; uint64_t ReadTSCP(uint32_t* aux);
+global ReadTSCP
+ReadTSCP:
+    push rcx            ; no_caller_saved_registers: rax 以外は戻す
+    push rdx
+    rdtscp
+    mov [rdi], ecx      ; *aux = IA32_TSC_AUX
+    shl rdx, 32
+    or rax, rdx         ; rax = edx:eax
+    pop rdx
+    pop rcx
+    ret
+
+; void StiHlt(void);
+global StiHlt
+StiHlt:
+    sti                 ; sti の直後の1命令は割り込まれないので、
+    hlt                 ; 割り込みを許可してから停止するまでの間に割り込みを取りこぼさない
+    ret
+
+; void Monitor(const void* addr);
+global Monitor
+Monitor:
+    mov rax, rdi        ; rax = addr
+    xor ecx, ecx        ; ecx = extensions
+    xor edx, edx        ; edx = hints
+    monitor
+    ret
+
+; void MWait(uint32_t hints, uint32_t extensions);
+global MWait
+MWait:
+    mov eax, edi        ; eax = hints
+    mov ecx, esi        ; ecx = extensions
+    mwait
+    ret
+
 extern kernel_main_stack
 extern KernelMainNewStack
 
@@ -3,12 +3,34 @@
 #include <stdint.h>
 
 extern "C" {
+    // no_caller_saved_registers の関数は割り込みハンドラから呼ぶ 使うレジスタは自分で戻す
     void IoOut32(uint16_t addr, uint32_t data);
     uint32_t IoIn32(uint16_t addr);
+    void __attribute__((no_caller_saved_registers)) IoOut8(uint16_t addr, uint8_t data);
+    uint8_t __attribute__((no_caller_saved_registers)) IoIn8(uint16_t addr);
     uint16_t GetCS(void);
     void LoadIDT(uint16_t limit, uint64_t offset);
     void LoadGDT(uint16_t limit, uint64_t offset);
     void SetCSSS(uint16_t cs, uint16_t ss);
     void SetDSAll(uint16_t value);
     void SetCR3(uint64_t value);
+    uint64_t GetCR3(void);
+    uint64_t ReadMSR(uint32_t msr);
+    void WriteMSR(uint32_t msr, uint64_t value);
+    void WriteBackAndInvalidateCache(void);
+    uint64_t GetCR0(void);
+    void SetCR0(uint64_t value);
+    uint64_t GetCR4(void);
+    void SetCR4(uint64_t value);
+    uint64_t XGetBV(uint32_t xcr);
+    void XSetBV(uint32_t xcr, uint64_t value);
+    void __attribute__((no_caller_saved_registers)) FXSave(void* area);
+    void __attribute__((no_caller_saved_registers)) FXRstor(const void* area);
+    void __attribute__((no_caller_saved_registers)) XSave(void* area, uint64_t mask);
+    void __attribute__((no_caller_saved_registers)) XRstor(const void* area, uint64_t mask);
+    uint64_t __attribute__((no_caller_saved_registers)) ReadTSC(void);
+    uint64_t __attribute__((no_caller_saved_registers)) ReadTSCP(uint32_t* aux);
+    void StiHlt(void);
+    void Monitor(const void* addr);
+    void MWait(uint32_t hints, uint32_t extensions);
 }
@@ -8,6 +8,7 @@
 
 #include "font.hpp"
 #include "layer.hpp"
+#include <algorithm>
 #include <cstring>
 
 Console::Console(const PixelColor& fg_color, const PixelColor& bg_color)
@@ -16,25 +17,41 @@ Console::Console(const PixelColor& fg_color, const PixelColor& bg_color)
     , fg_color_{ fg_color }
     , bg_color_{ bg_color }
     , buffer_{}
+    , top_line_{ 0 }
+    , scrollback_rows_{ 0 }
+    , view_offset_{ 0 }
+    , top_row_{ 0 }
     , cursor_row_{ 0 }
     , cursor_column_{ 0 }
     , layer_id_{ 0 } {}
 
 void
 Console::PutString(const char* s) {
+    if (view_offset_ != 0) {
+        view_offset_ = 0;
+        Refresh();
+    }
+
     while (*s) {
         if (*s == '\n') {
             Newline();
         } else if (cursor_column_ < kColumns - 1) {
-            WriteAscii(
-                *writer_, Vector2D<int>{ 8 * cursor_column_, 16 * cursor_row_ }, *s, fg_color_);
-            buffer_[cursor_row_][cursor_column_] = *s;
+            WriteAscii(*writer_,
+                       Vector2D<int>{ 8 * cursor_column_, RowY(cursor_row_) },
+                       *s,
+                       fg_color_,
+                       bg_color_);
+            Line(cursor_row_)[cursor_column_] = *s;
             ++cursor_column_;
         }
         ++s;
     }
-    if (layer_manager) {
-        layer_manager->Draw(layer_id_);
+}
+
+void
+Console::Flush() {
+    if (window_ && layer_manager) {
+        layer_manager->Flush();
     }
 }
 
@@ -68,6 +85,16 @@ Console::LayerID() const {
     return layer_id_;
 }
 
+void
+Console::ScrollView(int rows) {
+    const int offset = std::clamp(view_offset_ + rows, 0, scrollback_rows_);
+    if (offset == view_offset_) {
+        return;
+    }
+    view_offset_ = offset;
+    Refresh();
+}
+
 void
 Console::Newline() {
     cursor_column_ = 0;
@@ -75,24 +102,51 @@ Console::Newline() {
         ++cursor_row_;
         return;
     }
+
+    // 先頭行を履歴に回し、最も古い履歴の行を新しい最終行として使う
+    top_line_ = (top_line_ + 1) % kBufferRows;
+    if (scrollback_rows_ < kScrollbackRows) {
+        ++scrollback_rows_;
+    }
+    memset(Line(kRows - 1), 0, kColumns + 1);
+
     if (window_) {
-        Rectangle<int> move_src{ { 0, 16 }, { 8 * kColumns, 16 * (kRows - 1) } };
-        window_->Move({ 0, 0 }, move_src);
-        FillRectangle(*writer_, { 0, 16 * (kRows - 1) }, { 8 * kColumns, 16 }, bg_color_);
+        // 画面から消えた行を最終行として描き直し、表示の先頭をずらすだけで済ませる
+        top_row_ = (top_row_ + 1) % kRows;
+        FillRectangle(*writer_, { 0, RowY(kRows - 1) }, { 8 * kColumns, 16 }, bg_color_);
+        window_->SetScrollOrigin(16 * top_row_);
     } else {
-        FillRectangle(*writer_, { 0, 0 }, { 8 * kColumns, 16 * kRows }, bg_color_);
-        for (int row = 0; row < kRows - 1; ++row) {
-            memcpy(buffer_[row], buffer_[row + 1], kColumns + 1);
-            WriteString(*writer_, Vector2D<int>{ 0, 16 * row }, buffer_[row], fg_color_);
-        }
-        memset(buffer_[kRows - 1], 0, kColumns + 1);
+        // 描画先を回転できないので全体を描き直す
+        // ウィンドウを使わないのはレイヤーを用意する前の起動中だけで、描画先は画面の
+        // フレームバッファ (WC) になる 行をコピーして上へずらすと画面全体を読み出すことになり、
+        // 書き込むだけの描き直しより遅いので、ここでは行のコピーによるスクロールはしない
+        Refresh();
     }
 }
 
 void
 Console::Refresh() {
+    top_row_ = 0;
+    if (window_) {
+        window_->SetScrollOrigin(0);
+    }
     FillRectangle(*writer_, { 0, 0 }, { 8 * kColumns, 16 * kRows }, bg_color_);
     for (int row = 0; row < kRows; ++row) {
-        WriteString(*writer_, Vector2D<int>{ 0, 16 * row }, buffer_[row], fg_color_);
+        WriteString(*writer_, Vector2D<int>{ 0, RowY(row) }, ViewLine(row), fg_color_);
     }
 }
+
+char*
+Console::Line(int row) {
+    return buffer_[(top_line_ + row) % kBufferRows];
+}
+
+const char*
+Console::ViewLine(int row) const {
+    return buffer_[(top_line_ - view_offset_ + row + kBufferRows) % kBufferRows];
+}
+
+int
+Console::RowY(int row) const {
+    return 16 * ((top_row_ + row) % kRows);
+}
@@ -7,22 +7,61 @@
 class Console {
   public:
     static const int kRows = 25, kColumns = 80;
+    /** @brief 画面から流れ出た行を何行まで保持するか */
+    static const int kScrollbackRows = 200;
 
     Console(const PixelColor& fg_color, const PixelColor& bg_color_);
+    /**
+     * @brief 文字列を書き込む
+     *
+     * ウィンドウに書き込む場合は書き換えた範囲を記録するだけで、画面への反映は
+     * メインループの LayerManager::Flush にまとめて任せる
+     */
     void PutString(const char* s);
+    /**
+     * @brief 書き込んだ内容をただちに画面へ反映する
+     *
+     * メインループに戻らずに停止するパニック時などに使う
+     */
+    void Flush();
     void SetWriter(PixelWriter* writer);
     void SetWindow(const std::shared_ptr<Window>& window);
     void SetLayerID(unsigned int layer_id);
     unsigned int LayerID() const;
 
+    /**
+     * @brief 表示を画面から流れ出た行の方へ rows 行ずらす
+     *
+     * 負の値なら新しい行の方へ戻す ずらす量は保持している流れ出た行の数までに制限する
+     * 次に PutString で書き込むと、表示は最新の行へ戻る
+     */
+    void ScrollView(int rows);
+
   private:
+    static const int kBufferRows = kRows + kScrollbackRows;
+
     void Newline();
     void Refresh();
+    /** @brief 画面上 row 行目の文字列を返す */
+    char* Line(int row);
+    /** @brief 表示をずらしている間に、画面上 row 行目に表示する文字列を返す */
+    const char* ViewLine(int row) const;
+    /** @brief 画面上 row 行目を描画する y 座標を返す */
+    int RowY(int row) const;
 
     PixelWriter* writer_;
     std::shared_ptr<Window> window_;
     const PixelColor fg_color_, bg_color_;
-    char buffer_[kRows][kColumns + 1];
+    /** @brief 行単位のリングバッファ 画面の行と、その前に流れ出た行を保持する */
+    char buffer_[kBufferRows][kColumns + 1];
+    /** @brief 画面の先頭行を保持している buffer_ の行 */
+    int top_line_;
+    /** @brief buffer_ に保持している流れ出た行の数 */
+    int scrollback_rows_;
+    /** @brief 表示を流れ出た行の方へずらしている行数 0 なら最新の行を表示している */
+    int view_offset_;
+    /** @brief 画面の先頭行を描いているウィンドウ上の行 ウィンドウを使わない場合は常に 0 */
+    int top_row_;
     int cursor_row_, cursor_column_;
     unsigned int layer_id_;
 };
@@ -1,5 +1,9 @@
 #include "font.hpp"
 
+#include <array>
+
+#include "hankaku_tables.hpp"
+
 extern const uint8_t _binary_hankaku_bin_start;
 extern const uint8_t _binary_hankaku_bin_end;
 extern const uint8_t _binary_hankaku_bin_size;
@@ -13,19 +17,120 @@ GetFont(char c) {
     return &_binary_hankaku_bin_start + index;
 }
 
-void
-WriteAscii(PixelWriter& writer, Vector2D<int> pos, char c, const PixelColor& color) {
-    const uint8_t* font = GetFont(c);
-    if (font == nullptr) {
-        return;
+namespace {
+    /** @brief グリフキャッシュの1要素 (文字, 前景色, 背景色, ピクセル形式) ごとに展開結果を持つ */
+    struct GlyphCacheEntry {
+        bool valid;
+        char c;
+        PixelColor fg;
+        std::optional<PixelColor> bg;
+        PixelFormat format;
+        NativeGlyph glyph;
+    };
+
+    /** @brief グリフキャッシュの要素数 2 のべき乗とする */
+    const size_t kGlyphCacheSize = 256;
+    std::array<GlyphCacheEntry, kGlyphCacheSize> glyph_cache;
+
+    size_t GlyphCacheIndex(char c,
+                           const PixelColor& fg,
+                           const std::optional<PixelColor>& bg,
+                           PixelFormat format) {
+        size_t h = static_cast<uint8_t>(c);
+        h = h * 31 + (fg.r ^ fg.g << 3 ^ fg.b << 6);
+        if (bg) {
+            h = h * 31 + (bg->r ^ bg->g << 3 ^ bg->b << 6) + 1;
+        }
+        h = h * 31 + format;
+        return h & (kGlyphCacheSize - 1);
     }
-    for (int dy = 0; dy < 16; ++dy) {
-        for (int dx = 0; dx < 8; ++dx) {
-            if ((font[dy] << dx) & 0x80u) {
-                writer.Write(pos + Vector2D<int>{ dx, dy }, color);
+
+    /**
+     * @brief 1ビット/ピクセルのフォントを指定された色と形式の NativeGlyph に展開する
+     *
+     * ビットの解読は makefont.py が生成した kFontLaneMasks の表引きで済ませる
+     */
+    void ExpandGlyph(char c,
+                     const uint8_t* font,
+                     const PixelColor& fg,
+                     const std::optional<PixelColor>& bg,
+                     PixelFormat format,
+                     NativeGlyph& glyph) {
+        const uint32_t fg_native = ToNativePixel(format, fg);
+        const uint32_t bg_native = bg ? ToNativePixel(format, *bg) : 0;
+        const uint32_t diff = fg_native ^ bg_native;
+        glyph.format = format;
+        for (int dy = 0; dy < NativeGlyph::kHeight; ++dy) {
+            const uint32_t* lanes = kFontLaneMasks[font[dy]];
+            for (int dx = 0; dx < NativeGlyph::kWidth; ++dx) {
+                glyph.pixels[dy][dx] = bg_native ^ (diff & lanes[dx]);
             }
+            glyph.masks[dy] = bg ? 0xffu : font[dy];
         }
+
+        // 背景を塗る場合は全列、そうでなければ点のある列だけを書き込む
+        const auto& extent = kGlyphExtents[static_cast<uint8_t>(c)];
+        glyph.begin = bg ? 0 : extent.begin;
+        glyph.end = bg ? NativeGlyph::kWidth : extent.end;
     }
+
+    /** @brief キャッシュから展開済みの文字を探し、無ければ展開してキャッシュに入れる */
+    const NativeGlyph& GetNativeGlyph(char c,
+                                      const uint8_t* font,
+                                      const PixelColor& fg,
+                                      const std::optional<PixelColor>& bg,
+                                      PixelFormat format) {
+        auto& entry = glyph_cache[GlyphCacheIndex(c, fg, bg, format)];
+        if (!entry.valid || entry.c != c || entry.fg != fg || entry.bg != bg ||
+            entry.format != format) {
+            entry.valid = true;
+            entry.c = c;
+            entry.fg = fg;
+            entry.bg = bg;
+            entry.format = format;
+            ExpandGlyph(c, font, fg, bg, format, entry.glyph);
+        }
+        return entry.glyph;
+    }
+
+    void WriteAsciiImpl(PixelWriter& writer,
+                        Vector2D<int> pos,
+                        char c,
+                        const PixelColor& color,
+                        const std::optional<PixelColor>& bg_color) {
+        const uint8_t* font = GetFont(c);
+        if (font == nullptr) {
+            return;
+        }
+
+        if (auto format = writer.NativeFormat()) {
+            writer.WriteGlyph(pos, GetNativeGlyph(c, font, color, bg_color, *format));
+            return;
+        }
+
+        if (bg_color) {
+            writer.FillRect(pos, { NativeGlyph::kWidth, NativeGlyph::kHeight }, *bg_color);
+        }
+        for (int dy = 0; dy < 16; ++dy) {
+            if (font[dy]) {
+                writer.WriteMaskedRow(pos + Vector2D<int>{ 0, dy }, font[dy], color);
+            }
+        }
+    }
+}
+
+void
+WriteAscii(PixelWriter& writer, Vector2D<int> pos, char c, const PixelColor& color) {
+    WriteAsciiImpl(writer, pos, c, color, std::nullopt);
+}
+
+void
+WriteAscii(PixelWriter& writer,
+           Vector2D<int> pos,
+           char c,
+           const PixelColor& color,
+           const PixelColor& bg_color) {
+    WriteAsciiImpl(writer, pos, c, color, bg_color);
 }
 
 void
@@ -34,3 +139,14 @@ WriteString(PixelWriter& writer, Vector2D<int> pos, const char* s, const PixelCo
         WriteAscii(writer, pos + Vector2D<int>{ 8 * i, 0 }, s[i], color);
     }
 }
+
+void
+WriteString(PixelWriter& writer,
+            Vector2D<int> pos,
+            const char* s,
+            const PixelColor& color,
+            const PixelColor& bg_color) {
+    for (int i = 0; s[i] != '\0'; ++i) {
+        WriteAscii(writer, pos + Vector2D<int>{ 8 * i, 0 }, s[i], color, bg_color);
+    }
+}
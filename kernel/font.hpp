@@ -6,5 +6,21 @@
 void
 WriteAscii(PixelWriter& writer, Vector2D<int> pos, char c, const PixelColor& color);
 
+// 文字セル (8x16) 全体を背景色 bg_color で塗りつつ、文字を色 color で書く
 void
-WriteString(PixelWriter& writer, Vector2D<int> pos, const char* s, const PixelColor& color);
\ No newline at end of file
+WriteAscii(PixelWriter& writer,
+           Vector2D<int> pos,
+           char c,
+           const PixelColor& color,
+           const PixelColor& bg_color);
+
+void
+WriteString(PixelWriter& writer, Vector2D<int> pos, const char* s, const PixelColor& color);
+
+// 各文字セルを背景色 bg_color で塗りつつ、文字列を色 color で書く
+void
+WriteString(PixelWriter& writer,
+            Vector2D<int> pos,
+            const char* s,
+            const PixelColor& color,
+            const PixelColor& bg_color);
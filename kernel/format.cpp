@@ -0,0 +1,263 @@
+/**
+ * @file format.cpp
+ *
+ * printf 形式の書式化のプログラムを集めたファイル
+ */
+
+#include "format.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+    /** @brief 1つの変換指定 */
+    struct Spec {
+        bool left = false;
+        bool zero = false;
+        int width = 0;
+        int precision = -1;
+    };
+
+    void WritePadding(FormatSink& sink, char c, int n) {
+        char pad[16];
+        memset(pad, c, sizeof(pad));
+        while (n > 0) {
+            const int chunk = n < static_cast<int>(sizeof(pad)) ? n : sizeof(pad);
+            sink.Write(pad, chunk);
+            n -= chunk;
+        }
+    }
+
+    /** @brief 幅に合わせて prefix と body を出力し、出力した文字数を返す */
+    int WriteField(FormatSink& sink,
+                   const Spec& spec,
+                   const char* prefix,
+                   int zeros,
+                   const char* body,
+                   int body_length) {
+        const int prefix_length = strlen(prefix);
+        const int length = prefix_length + zeros + body_length;
+        const int padding = spec.width > length ? spec.width - length : 0;
+
+        if (!spec.left && !spec.zero) {
+            WritePadding(sink, ' ', padding);
+        }
+        sink.Write(prefix, prefix_length);
+        WritePadding(sink, '0', zeros + (!spec.left && spec.zero ? padding : 0));
+        sink.Write(body, body_length);
+        if (spec.left) {
+            WritePadding(sink, ' ', padding);
+        }
+        return length + padding;
+    }
+
+    int WriteNumber(FormatSink& sink,
+                    Spec spec,
+                    uint64_t value,
+                    bool negative,
+                    unsigned int base,
+                    bool upper,
+                    const char* prefix) {
+        const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+        char buf[24];
+        int i = sizeof(buf);
+        do {
+            buf[--i] = digits[value % base];
+            value /= base;
+        } while (value);
+        const int length = sizeof(buf) - i;
+
+        int zeros = 0;
+        if (spec.precision >= 0) {
+            // 精度の指定があれば '0' フラグは無視する
+            zeros = spec.precision > length ? spec.precision - length : 0;
+            spec.zero = false;
+        }
+        return WriteField(sink, spec, negative ? "-" : prefix, zeros, &buf[i], length);
+    }
+
+    /** @brief 長さ修飾子に従って符号付き整数の引数を取り出す */
+    int64_t SignedArg(va_list& ap, int long_count, bool size) {
+        if (size || long_count >= 1) {
+            return va_arg(ap, long);
+        }
+        return va_arg(ap, int);
+    }
+
+    /** @brief 長さ修飾子に従って符号無し整数の引数を取り出す */
+    uint64_t UnsignedArg(va_list& ap, int long_count, bool size) {
+        if (size || long_count >= 1) {
+            return va_arg(ap, unsigned long);
+        }
+        return va_arg(ap, unsigned int);
+    }
+}
+
+BufferSink::BufferSink(char* buf, size_t size)
+    : buf_{ buf }
+    , size_{ size }
+    , length_{ 0 } {
+    buf_[0] = '\0';
+}
+
+void
+BufferSink::Write(const char* s, size_t length) {
+    const size_t space = size_ - 1 - length_;
+    const size_t n = length < space ? length : space;
+    memcpy(buf_ + length_, s, n);
+    length_ += n;
+    buf_[length_] = '\0';
+}
+
+size_t
+BufferSink::Length() const {
+    return length_;
+}
+
+int
+VFormat(FormatSink& sink, const char* format, va_list ap) {
+    // va_list が配列型の環境でも参照として渡せるよう、コピーして使う
+    va_list args;
+    va_copy(args, ap);
+
+    int total = 0;
+    const char* p = format;
+    while (*p) {
+        // 変換指定までの文字はまとめて出力する
+        const char* text = p;
+        while (*p && *p != '%') {
+            ++p;
+        }
+        if (p != text) {
+            sink.Write(text, p - text);
+            total += p - text;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        const char* spec_begin = p++;
+        Spec spec;
+        for (;; ++p) {
+            if (*p == '-') {
+                spec.left = true;
+            } else if (*p == '0') {
+                spec.zero = true;
+            } else {
+                break;
+            }
+        }
+        if (*p == '*') {
+            spec.width = va_arg(args, int);
+            if (spec.width < 0) {
+                spec.left = true;
+                spec.width = -spec.width;
+            }
+            ++p;
+        } else {
+            for (; '0' <= *p && *p <= '9'; ++p) {
+                spec.width = spec.width * 10 + (*p - '0');
+            }
+        }
+        if (*p == '.') {
+            spec.precision = 0;
+            for (++p; '0' <= *p && *p <= '9'; ++p) {
+                spec.precision = spec.precision * 10 + (*p - '0');
+            }
+        }
+
+        int long_count = 0;
+        bool size = false;
+        for (;; ++p) {
+            if (*p == 'l') {
+                ++long_count;
+            } else if (*p == 'z') {
+                size = true;
+            } else if (*p != 'h') { // char と short は int に格上げされて渡される
+                break;
+            }
+        }
+
+        switch (*p) {
+            case 'd':
+            case 'i': {
+                const int64_t v = SignedArg(args, long_count, size);
+                const uint64_t abs = v < 0 ? -static_cast<uint64_t>(v) : v;
+                total += WriteNumber(sink, spec, abs, v < 0, 10, false, "");
+                break;
+            }
+            case 'u':
+                total += WriteNumber(
+                    sink, spec, UnsignedArg(args, long_count, size), false, 10, false, "");
+                break;
+            case 'x':
+            case 'X':
+                total += WriteNumber(
+                    sink, spec, UnsignedArg(args, long_count, size), false, 16, *p == 'X', "");
+                break;
+            case 'p':
+                total += WriteNumber(sink,
+                                     spec,
+                                     reinterpret_cast<uintptr_t>(va_arg(args, void*)),
+                                     false,
+                                     16,
+                                     false,
+                                     "0x");
+                break;
+            case 's': {
+                const char* s = va_arg(args, const char*);
+                if (s == nullptr) {
+                    s = "(null)";
+                }
+                int length = strlen(s);
+                if (spec.precision >= 0 && spec.precision < length) {
+                    length = spec.precision;
+                }
+                spec.zero = false;
+                total += WriteField(sink, spec, "", 0, s, length);
+                break;
+            }
+            case 'c': {
+                const char c = va_arg(args, int);
+                spec.zero = false;
+                total += WriteField(sink, spec, "", 0, &c, 1);
+                break;
+            }
+            case '%':
+                sink.Write("%", 1);
+                ++total;
+                break;
+            default:
+                // 対応しない変換指定はそのまま出力する
+                if (*p == '\0') {
+                    --p;
+                }
+                sink.Write(spec_begin, p + 1 - spec_begin);
+                total += p + 1 - spec_begin;
+                break;
+        }
+        ++p;
+    }
+
+    va_end(args);
+    return total;
+}
+
+int
+Format(FormatSink& sink, const char* format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    const int result = VFormat(sink, format, ap);
+    va_end(ap);
+    return result;
+}
+
+int
+FormatString(char* buf, size_t size, const char* format, ...) {
+    BufferSink sink{ buf, size };
+    va_list ap;
+    va_start(ap, format);
+    const int result = VFormat(sink, format, ap);
+    va_end(ap);
+    return result;
+}
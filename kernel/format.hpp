@@ -0,0 +1,53 @@
+/**
+ * @file format.hpp
+ *
+ * printf 形式の書式化を、中間バッファを使わずに出力先へ直接行う関数群を提供する
+ */
+
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+
+/** @brief 書式化した文字列を受け取る出力先 */
+class FormatSink {
+  public:
+    virtual ~FormatSink() = default;
+    /** @brief 書式化した文字列の一部を受け取る s は '\0' で終わるとは限らない */
+    virtual void Write(const char* s, size_t length) = 0;
+};
+
+/** @brief 固定長のバッファへ書き込む出力先 入りきらない分は捨て、常に '\0' で終える */
+class BufferSink : public FormatSink {
+  public:
+    /** @param size  '\0' を含めたバッファのバイト数 1 以上であること */
+    BufferSink(char* buf, size_t size);
+    virtual void Write(const char* s, size_t length) override;
+    /** @brief バッファに書き込んだバイト数を返す ('\0' を除く) */
+    size_t Length() const;
+
+  private:
+    char* buf_;
+    size_t size_, length_;
+};
+
+/**
+ * @brief format に従って書式化した文字列を sink へ出力する
+ *
+ * 対応する変換は %d %i %u %x %X %p %s %c %% で、フラグ '-' '0'、幅 (数値か '*')、
+ * 精度、長さ修飾子 hh h l ll z を受け付ける 浮動小数点数には対応しない
+ *
+ * @return 出力した文字数
+ */
+int
+VFormat(FormatSink& sink, const char* format, va_list ap) __attribute__((format(printf, 2, 0)));
+/** @brief 可変長引数を取る VFormat */
+int
+Format(FormatSink& sink, const char* format, ...) __attribute__((format(printf, 2, 3)));
+/**
+ * @brief 書式化した文字列を buf へ書き込む snprintf の代わりに使う
+ *
+ * @return 切り詰めなかった場合に書き込むはずの文字数 ('\0' を除く)
+ */
+int
+FormatString(char* buf, size_t size, const char* format, ...) __attribute__((format(printf, 3, 4)));
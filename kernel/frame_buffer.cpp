@@ -2,30 +2,222 @@
 
 #include <cstring>
 
+#include "simd.hpp"
+
 namespace {
     int BytesPerPixel(PixelFormat format) {
         switch (format) {
             case kPixelRGBResv8BitPerColor:
-                return 4;
+                return PixelFormatTraits<kPixelRGBResv8BitPerColor>::kBytesPerPixel;
             case kPixelBGRResv8BitPerColor:
-                return 4;
+                return PixelFormatTraits<kPixelBGRResv8BitPerColor>::kBytesPerPixel;
         }
         return -1;
     }
 
-    uint8_t* FrameAddrAt(Vector2D<int> pos, const FrameBufferConfig& config) {
-        return config.frame_buffer +
-               BytesPerPixel(config.pixel_format) * (config.pixels_per_scan_line * pos.y + pos.x);
+    Vector2D<int> FrameBufferSize(const FrameBufferConfig& config) {
+        return { static_cast<int>(config.horizontal_resolution),
+                 static_cast<int>(config.vertical_resolution) };
     }
 
-    int BytesPerScanLine(const FrameBufferConfig& config) {
-        return BytesPerPixel(config.pixel_format) * config.pixels_per_scan_line;
+    template<PixelFormat F>
+    uint32_t* PixelAddrAt(Vector2D<int> pos, const FrameBufferConfig& config) {
+        constexpr int kBytesPerPixel = PixelFormatTraits<F>::kBytesPerPixel;
+        static_assert(kBytesPerPixel == sizeof(uint32_t));
+        return reinterpret_cast<uint32_t*>(
+            config.frame_buffer + kBytesPerPixel * (config.pixels_per_scan_line * pos.y + pos.x));
     }
 
-    Vector2D<int> FrameBufferSize(const FrameBufferConfig& config) {
-        return { static_cast<int>(config.horizontal_resolution),
-                 static_cast<int>(config.vertical_resolution) };
+    /** @brief 転送元と転送先の両方に収まるようにクリップした転送範囲 */
+    struct BlitArea {
+        Vector2D<int> dst_pos, src_pos, size;
+    };
+
+    BlitArea ClipBlitArea(const FrameBufferConfig& dst,
+                          Vector2D<int> dst_pos,
+                          const FrameBufferConfig& src,
+                          const Rectangle<int>& src_area) {
+        const Rectangle<int> src_area_shifted{ dst_pos, src_area.size };
+        const Rectangle<int> src_outline{ dst_pos - src_area.pos, FrameBufferSize(src) };
+        const Rectangle<int> dst_outline{ { 0, 0 }, FrameBufferSize(dst) };
+        const auto copy_area = dst_outline & src_outline & src_area_shifted;
+        return { copy_area.pos, copy_area.pos - (dst_pos - src_area.pos), copy_area.size };
+    }
+
+    template<PixelFormat Dst, PixelFormat Src>
+    void CopyRows(const FrameBufferConfig& dst, const FrameBufferConfig& src, const BlitArea& area) {
+        using DstTraits = PixelFormatTraits<Dst>;
+        using SrcTraits = PixelFormatTraits<Src>;
+        constexpr bool kSameLayout = DstTraits::kROffset == SrcTraits::kROffset &&
+                                     DstTraits::kGOffset == SrcTraits::kGOffset &&
+                                     DstTraits::kBOffset == SrcTraits::kBOffset;
+
+        uint32_t* dst_row = PixelAddrAt<Dst>(area.dst_pos, dst);
+        const uint32_t* src_row = PixelAddrAt<Src>(area.src_pos, src);
+        for (int y = 0; y < area.size.y; ++y) {
+            if constexpr (kSameLayout) {
+                Copy32(dst_row, src_row, area.size.x);
+            } else {
+                // RGB と BGR の間のコピーはバイト 0 と 2 を入れ替えながら行う
+                SwapRB32(dst_row, src_row, area.size.x);
+            }
+            dst_row += dst.pixels_per_scan_line;
+            src_row += src.pixels_per_scan_line;
+        }
+    }
+
+    template<PixelFormat F>
+    void StreamRows(const FrameBufferConfig& dst, const FrameBufferConfig& src, const BlitArea& area) {
+        uint32_t* dst_row = PixelAddrAt<F>(area.dst_pos, dst);
+        const uint32_t* src_row = PixelAddrAt<F>(area.src_pos, src);
+        for (int y = 0; y < area.size.y; ++y) {
+            StreamCopy32(dst_row, src_row, area.size.x);
+            dst_row += dst.pixels_per_scan_line;
+            src_row += src.pixels_per_scan_line;
+        }
+        StreamFence();
+    }
+
+    template<PixelFormat F>
+    void CopyMaskedRows(const FrameBufferConfig& dst,
+                        const FrameBufferConfig& src,
+                        const BlitArea& area,
+                        const RunMask& mask) {
+        const int src_begin = area.src_pos.x;
+        const int src_end = area.src_pos.x + area.size.x;
+        uint32_t* dst_row = PixelAddrAt<F>(area.dst_pos, dst) - src_begin;
+        const uint32_t* src_row = PixelAddrAt<F>(area.src_pos, src) - src_begin;
+        for (int y = area.src_pos.y; y < area.src_pos.y + area.size.y; ++y) {
+            for (size_t i = mask.row_index[y]; i < mask.row_index[y + 1]; ++i) {
+                const int begin = std::max(mask.runs[i].begin, src_begin);
+                const int end = std::min(mask.runs[i].end, src_end);
+                if (begin < end) {
+                    Copy32(dst_row + begin, src_row + begin, end - begin);
+                }
+            }
+            dst_row += dst.pixels_per_scan_line;
+            src_row += src.pixels_per_scan_line;
+        }
     }
+
+    template<PixelFormat F>
+    void MoveRows(const FrameBufferConfig& config, Vector2D<int> dst_pos, const Rectangle<int>& src) {
+        const auto stride = static_cast<int>(config.pixels_per_scan_line);
+
+        // 同じ行の中で移動する場合だけは転送元と転送先が重なり得る
+        auto copy_row = [&](uint32_t* dst_row, const uint32_t* src_row) {
+            if (dst_pos.y == src.pos.y) {
+                memmove(dst_row, src_row, sizeof(uint32_t) * src.size.x);
+            } else {
+                Copy32(dst_row, src_row, src.size.x);
+            }
+        };
+
+        if (dst_pos.y < src.pos.y) {
+            uint32_t* dst_row = PixelAddrAt<F>(dst_pos, config);
+            const uint32_t* src_row = PixelAddrAt<F>(src.pos, config);
+            for (int y = 0; y < src.size.y; ++y) {
+                copy_row(dst_row, src_row);
+                dst_row += stride;
+                src_row += stride;
+            }
+        } else {
+            uint32_t* dst_row = PixelAddrAt<F>(dst_pos + Vector2D<int>{ 0, src.size.y - 1 }, config);
+            const uint32_t* src_row =
+                PixelAddrAt<F>(src.pos + Vector2D<int>{ 0, src.size.y - 1 }, config);
+            for (int y = 0; y < src.size.y; ++y) {
+                copy_row(dst_row, src_row);
+                dst_row -= stride;
+                src_row -= stride;
+            }
+        }
+    }
+
+    template<PixelFormat Dst>
+    Error CopyFrom(const FrameBufferConfig& dst, const FrameBufferConfig& src, const BlitArea& area) {
+        switch (src.pixel_format) {
+            case kPixelRGBResv8BitPerColor:
+                CopyRows<Dst, kPixelRGBResv8BitPerColor>(dst, src, area);
+                return MAKE_ERROR(Error::kSuccess);
+            case kPixelBGRResv8BitPerColor:
+                CopyRows<Dst, kPixelBGRResv8BitPerColor>(dst, src, area);
+                return MAKE_ERROR(Error::kSuccess);
+        }
+        return MAKE_ERROR(Error::kUnknownPixelFormat);
+    }
+
+    template<PixelFormat F>
+    void Blit(FrameBuffer& dst,
+              Vector2D<int> dst_pos,
+              const FrameBuffer& src,
+              const Rectangle<int>& src_area) {
+        const auto area = ClipBlitArea(dst.Config(), dst_pos, src.Config(), src_area);
+        CopyRows<F, F>(dst.Config(), src.Config(), area);
+    }
+
+    template<PixelFormat F>
+    void BlitStreaming(FrameBuffer& dst,
+                       Vector2D<int> dst_pos,
+                       const FrameBuffer& src,
+                       const Rectangle<int>& src_area) {
+        const auto area = ClipBlitArea(dst.Config(), dst_pos, src.Config(), src_area);
+        StreamRows<F>(dst.Config(), src.Config(), area);
+    }
+
+    template<PixelFormat F>
+    void BlitMasked(FrameBuffer& dst,
+                    Vector2D<int> dst_pos,
+                    const FrameBuffer& src,
+                    const Rectangle<int>& src_area,
+                    const RunMask& mask) {
+        const auto area = ClipBlitArea(dst.Config(), dst_pos, src.Config(), src_area);
+        CopyMaskedRows<F>(dst.Config(), src.Config(), area, mask);
+    }
+
+    template<PixelFormat F>
+    const Blitter kBlitter{ Blit<F>, BlitStreaming<F>, BlitMasked<F> };
+}
+
+void
+BuildRunMask(const FrameBuffer& src, uint32_t key, RunMask& mask) {
+    // 予約バイトは比較に含めない
+    const uint32_t kColorMask = 0x00ffffffu;
+    const auto& config = src.Config();
+    const int width = config.horizontal_resolution;
+    const int height = config.vertical_resolution;
+
+    mask.runs.clear();
+    mask.row_index.resize(height + 1);
+    auto row = reinterpret_cast<const uint32_t*>(config.frame_buffer);
+    for (int y = 0; y < height; ++y) {
+        mask.row_index[y] = mask.runs.size();
+        int x = 0;
+        while (x < width) {
+            while (x < width && (row[x] & kColorMask) == key) {
+                ++x;
+            }
+            const int begin = x;
+            while (x < width && (row[x] & kColorMask) != key) {
+                ++x;
+            }
+            if (begin < x) {
+                mask.runs.push_back({ begin, x });
+            }
+        }
+        row += config.pixels_per_scan_line;
+    }
+    mask.row_index[height] = mask.runs.size();
+}
+
+const Blitter*
+GetBlitter(PixelFormat format) {
+    switch (format) {
+        case kPixelRGBResv8BitPerColor:
+            return &kBlitter<kPixelRGBResv8BitPerColor>;
+        case kPixelBGRResv8BitPerColor:
+            return &kBlitter<kPixelBGRResv8BitPerColor>;
+    }
+    return nullptr;
 }
 
 Error
@@ -37,21 +229,24 @@ FrameBuffer::Initialize(const FrameBufferConfig& config) {
         return MAKE_ERROR(Error::kUnknownPixelFormat);
     }
 
+    // 自前のバッファはキャッシュされるが、渡されたバッファは画面のフレームバッファかもしれない
+    const bool cached = config_.frame_buffer == nullptr;
     if (config_.frame_buffer) {
         buffer_.resize(0);
     } else {
-        buffer_.resize(bytes_per_pixel * config_.horizontal_resolution *
+        config_.pixels_per_scan_line = (config_.horizontal_resolution + kScanLineAlignment - 1) &
+                                       ~(kScanLineAlignment - 1);
+        buffer_.resize(bytes_per_pixel * config_.pixels_per_scan_line *
                        config_.vertical_resolution);
         config_.frame_buffer = buffer_.data();
-        config_.pixels_per_scan_line = config_.horizontal_resolution;
     }
 
     switch (config_.pixel_format) {
         case kPixelRGBResv8BitPerColor:
-            writer_ = std::make_unique<RGBResv8BitPerColorPixelWriter>(config_);
+            writer_ = std::make_unique<RGBResv8BitPerColorPixelWriter>(config_, cached);
             break;
         case kPixelBGRResv8BitPerColor:
-            writer_ = std::make_unique<BGRResv8BitPerColorPixelWriter>(config_);
+            writer_ = std::make_unique<BGRResv8BitPerColorPixelWriter>(config_, cached);
             break;
         default:
             return MAKE_ERROR(Error::kUnknownPixelFormat);
@@ -62,53 +257,24 @@ FrameBuffer::Initialize(const FrameBufferConfig& config) {
 
 Error
 FrameBuffer::Copy(Vector2D<int> dst_pos, const FrameBuffer& src, const Rectangle<int>& src_area) {
-    if (config_.pixel_format != src.config_.pixel_format) {
-        return MAKE_ERROR(Error::kUnknownPixelFormat);
-    }
-
-    const auto bytes_per_pixel = BytesPerPixel(config_.pixel_format);
-    if (bytes_per_pixel <= 0) {
-        return MAKE_ERROR(Error::kUnknownPixelFormat);
-    }
-
-    const Rectangle<int> src_area_shifted{ dst_pos, src_area.size };
-    const Rectangle<int> src_outline{ dst_pos - src_area.pos, FrameBufferSize(src.config_) };
-    const Rectangle<int> dst_outline{ { 0, 0 }, FrameBufferSize(config_) };
-    const auto copy_area = dst_outline & src_outline & src_area_shifted;
-    const auto src_start_pos = copy_area.pos - (dst_pos - src_area.pos);
-
-    uint8_t* dst_buf = FrameAddrAt(copy_area.pos, config_);
-    const uint8_t* src_buf = FrameAddrAt(src_start_pos, src.config_);
-
-    for (int y = 0; y < copy_area.size.y; ++y) {
-        memcpy(dst_buf, src_buf, bytes_per_pixel * copy_area.size.x);
-        dst_buf += BytesPerScanLine(config_);
-        src_buf += BytesPerScanLine(src.config_);
+    const auto area = ClipBlitArea(config_, dst_pos, src.config_, src_area);
+    switch (config_.pixel_format) {
+        case kPixelRGBResv8BitPerColor:
+            return CopyFrom<kPixelRGBResv8BitPerColor>(config_, src.config_, area);
+        case kPixelBGRResv8BitPerColor:
+            return CopyFrom<kPixelBGRResv8BitPerColor>(config_, src.config_, area);
     }
-
-    return MAKE_ERROR(Error::kSuccess);
+    return MAKE_ERROR(Error::kUnknownPixelFormat);
 }
 
 void
 FrameBuffer::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
-    const auto bytes_per_pixel = BytesPerPixel(config_.pixel_format);
-    const auto bytes_per_scan_line = BytesPerScanLine(config_);
-
-    if (dst_pos.y < src.pos.y) {
-        uint8_t* dst_buf = FrameAddrAt(dst_pos, config_);
-        const uint8_t* src_buf = FrameAddrAt(src.pos, config_);
-        for (int y = 0; y < src.size.y; ++y) {
-            memcpy(dst_buf, src_buf, bytes_per_pixel * src.size.x);
-            dst_buf += bytes_per_scan_line;
-            src_buf += bytes_per_scan_line;
-        }
-    } else {
-        uint8_t* dst_buf = FrameAddrAt(dst_pos + Vector2D<int>{ 0, src.size.y - 1 }, config_);
-        const uint8_t* src_buf = FrameAddrAt(src.pos + Vector2D<int>{ 0, src.size.y - 1 }, config_);
-        for (int y = 0; y < src.size.y; ++y) {
-            memcpy(dst_buf, src_buf, bytes_per_pixel * src.size.x);
-            dst_buf -= bytes_per_scan_line;
-            src_buf -= bytes_per_scan_line;
-        }
+    switch (config_.pixel_format) {
+        case kPixelRGBResv8BitPerColor:
+            MoveRows<kPixelRGBResv8BitPerColor>(config_, dst_pos, src);
+            break;
+        case kPixelBGRResv8BitPerColor:
+            MoveRows<kPixelBGRResv8BitPerColor>(config_, dst_pos, src);
+            break;
     }
 }
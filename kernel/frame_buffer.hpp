@@ -7,15 +7,80 @@
 #include "frame_buffer_config.hpp"
 #include "graphics.hpp"
 
+class FrameBuffer;
+
+/** @brief 1行の中で連続する不透明なピクセルの範囲 [begin, end) */
+struct PixelRun {
+    int begin, end;
+};
+
+/**
+ * @brief 透過色を持つ画像の不透明な部分を、行ごとの PixelRun の列で表したもの
+ *
+ * y 行目の PixelRun は runs[row_index[y]] から runs[row_index[y + 1]] の手前まで
+ */
+struct RunMask {
+    std::vector<PixelRun> runs;
+    std::vector<size_t> row_index;
+};
+
+/** @brief src のうち透過色 key と異なるピクセルの範囲を行ごとに求めて mask に設定する */
+void
+BuildRunMask(const FrameBuffer& src, uint32_t key, RunMask& mask);
+
+/**
+ * @brief 描画先と描画元が同じピクセル形式であることを前提とした転送処理の組
+ *
+ * 形式ごとにテンプレートから生成され、ループ内に形式の分岐や間接呼び出しを含まない
+ * LayerManager は画面の形式に合わせて一度だけこれを選び、以後の合成に使う
+ */
+struct Blitter {
+    /** @brief src の src_area を dst の dst_pos へコピーする */
+    void (*copy)(FrameBuffer& dst,
+                 Vector2D<int> dst_pos,
+                 const FrameBuffer& src,
+                 const Rectangle<int>& src_area);
+    /**
+     * @brief copy と同じだが、キャッシュを汚さない書き込みを使う
+     *
+     * バックバッファから実際の画面へ大きな範囲を転送するときに使う
+     * 戻る前に sfence で書き込みを完了させる
+     */
+    void (*copy_streaming)(FrameBuffer& dst,
+                           Vector2D<int> dst_pos,
+                           const FrameBuffer& src,
+                           const Rectangle<int>& src_area);
+    /** @brief src の src_area のうち mask が示す不透明な部分だけを dst の dst_pos へコピーする */
+    void (*copy_masked)(FrameBuffer& dst,
+                        Vector2D<int> dst_pos,
+                        const FrameBuffer& src,
+                        const Rectangle<int>& src_area,
+                        const RunMask& mask);
+};
+
+/** @brief 指定したピクセル形式用の Blitter を返す 未知の形式なら nullptr を返す */
+const Blitter*
+GetBlitter(PixelFormat format);
+
 class FrameBuffer {
   public:
+    /**
+     * @brief フレームバッファを初期化する
+     *
+     * config.frame_buffer が nullptr なら自前のバッファを確保する
+     * その場合の1行のピクセル数は kScanLineAlignment の倍数に切り上げる
+     */
     Error Initialize(const FrameBufferConfig& config);
     Error Copy(Vector2D<int> dst_pos, const FrameBuffer& src, const Rectangle<int>& src_area);
     void Move(Vector2D<int> dst_pos, const Rectangle<int>& src);
 
     FrameBufferWriter& Writer() { return *writer_; }
+    const FrameBufferWriter& Writer() const { return *writer_; }
     const FrameBufferConfig& Config() const { return config_; }
 
+    /** @brief 自前で確保するバッファの1行のピクセル数の境界 (64 バイト) */
+    static const uint32_t kScanLineAlignment = 16;
+
   private:
     FrameBufferConfig config_{};
     std::vector<uint8_t> buffer_{};
@@ -0,0 +1,115 @@
+/**
+ * @file frame_scheduler.cpp
+ *
+ * Local APIC タイマによるフレームの管理と、その統計のプログラムを集めたファイル
+ */
+
+#include "frame_scheduler.hpp"
+
+#include <atomic>
+
+#include "asmfunc.h"
+#include "logger.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+
+namespace {
+    unsigned int frame_rate = kDefaultFrameRate;
+    uint8_t frame_vector = 0;
+
+    /** @brief これまでのタイマ割り込みの回数 */
+    std::atomic<uint64_t> ticks{ 0 };
+    /** @brief メインループへ知らせたフレームがまだ始まっていなければ true */
+    std::atomic<bool> tick_pending{ false };
+    std::atomic<uint64_t> skipped{ 0 };
+
+    uint64_t frames = 0, missed_deadlines = 0;
+    uint64_t last_frame_time = 0, max_frame_time = 0, total_frame_time = 0;
+    /** @brief 描画中のフレームが始まったときの TSC と ticks */
+    uint64_t frame_begin_tsc = 0, frame_begin_ticks = 0;
+
+    unsigned int ClampFrameRate(unsigned int rate) {
+        if (rate < kMinFrameRate) {
+            return kMinFrameRate;
+        }
+        if (rate > kMaxFrameRate) {
+            return kMaxFrameRate;
+        }
+        return rate;
+    }
+}
+
+void
+InitializeFrameScheduler(unsigned int rate, uint8_t vector) {
+    frame_vector = vector;
+    CalibrateLAPICTimer();
+    LOG(kLogKernel,
+        kInfo,
+        "LAPIC timer %lu Hz, TSC %lu Hz\n",
+        LAPICTimerFrequency(),
+        TSCFrequency());
+    SetFrameRate(rate);
+}
+
+void
+SetFrameRate(unsigned int rate) {
+    frame_rate = ClampFrameRate(rate);
+    StartLAPICTimerPeriodic(frame_rate, frame_vector);
+}
+
+unsigned int
+FrameRate() {
+    return frame_rate;
+}
+
+bool __attribute__((no_caller_saved_registers))
+OnFrameTick() {
+    ticks.fetch_add(1, std::memory_order_relaxed);
+    if (tick_pending.exchange(true, std::memory_order_acq_rel)) {
+        skipped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void __attribute__((no_caller_saved_registers))
+CancelFrameTick() {
+    skipped.fetch_add(1, std::memory_order_relaxed);
+    tick_pending.store(false, std::memory_order_release);
+}
+
+void
+BeginFrame(uint64_t tick_tsc) {
+    // ここから後に来た周期は、次のフレームとして知らせてよい
+    tick_pending.store(false, std::memory_order_release);
+    frame_begin_ticks = ticks.load(std::memory_order_relaxed);
+    frame_begin_tsc = ReadTSC();
+    Trace(kTraceFrameBegin, frames, frame_begin_tsc - tick_tsc);
+}
+
+void
+EndFrame() {
+    const uint64_t frame_time = ReadTSC() - frame_begin_tsc;
+    ++frames;
+    last_frame_time = frame_time;
+    total_frame_time += frame_time;
+    if (frame_time > max_frame_time) {
+        max_frame_time = frame_time;
+    }
+    if (ticks.load(std::memory_order_relaxed) != frame_begin_ticks) {
+        ++missed_deadlines;
+    }
+    Trace(kTraceFrameEnd, frame_time);
+}
+
+FrameStats
+GetFrameStats() {
+    return {
+        frames,
+        skipped.load(std::memory_order_relaxed),
+        missed_deadlines,
+        last_frame_time,
+        max_frame_time,
+        total_frame_time,
+    };
+}
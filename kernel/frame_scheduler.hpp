@@ -0,0 +1,67 @@
+/**
+ * @file frame_scheduler.hpp
+ *
+ * Local APIC タイマによる一定周期のフレームで画面の合成をまとめて行うためのプログラム
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/** @brief フレームレートの既定値 (Hz) */
+const unsigned int kDefaultFrameRate = 60;
+const unsigned int kMinFrameRate = 1;
+const unsigned int kMaxFrameRate = 1000;
+
+/** @brief フレームの統計 時間は TSC のカウント数 */
+struct FrameStats {
+    /** @brief 描画したフレームの数 */
+    uint64_t frames;
+    /** @brief 前のフレームの描画が始まる前に次の周期が来たため、描画しなかったフレームの数 */
+    uint64_t skipped;
+    /** @brief 描画中に次の周期が来てしまったフレームの数 */
+    uint64_t missed_deadlines;
+    uint64_t last_frame_time;
+    uint64_t max_frame_time;
+    uint64_t total_frame_time;
+};
+
+/**
+ * @brief Local APIC タイマを校正し、rate Hz のフレーム割り込みを vector で発生させる
+ *
+ * rate は kMinFrameRate 以上 kMaxFrameRate 以下に丸める
+ */
+void
+InitializeFrameScheduler(unsigned int rate, uint8_t vector);
+/** @brief フレームレートを変更する */
+void
+SetFrameRate(unsigned int rate);
+/** @brief 現在のフレームレート (Hz) を返す */
+unsigned int
+FrameRate();
+
+/**
+ * @brief タイマ割り込みから呼び、メインループへ新しいフレームを知らせるべきか返す
+ *
+ * 前のフレームの知らせがまだ処理されていなければ false を返し、
+ * そのフレームは飛ばしたものとして数える
+ */
+bool __attribute__((no_caller_saved_registers))
+OnFrameTick();
+/** @brief OnFrameTick が true を返したのにメインループへ知らせられなかったときに呼ぶ */
+void __attribute__((no_caller_saved_registers))
+CancelFrameTick();
+
+/**
+ * @brief メインループで1フレーム分の描画を始める前に呼ぶ
+ *
+ * @param tick_tsc  このフレームを知らせたタイマ割り込みが来たときの TSC
+ */
+void
+BeginFrame(uint64_t tick_tsc);
+/** @brief 1フレーム分の描画を画面へ反映した後に呼ぶ */
+void
+EndFrame();
+
+FrameStats
+GetFrameStats();
@@ -1,23 +1,99 @@
 #include "graphics.hpp"
 
-// RGB形式で8ビットごとに予約しているピクセル情報を書き込む
+#include "hankaku_tables.hpp"
+#include "simd.hpp"
+
+void
+PixelWriter::FillHLine(Vector2D<int> pos, int width, const PixelColor& c) {
+    for (int dx = 0; dx < width; ++dx) {
+        Write(pos + Vector2D<int>{ dx, 0 }, c);
+    }
+}
+
+void
+PixelWriter::FillRect(Vector2D<int> pos, Vector2D<int> size, const PixelColor& c) {
+    for (int dy = 0; dy < size.y; ++dy) {
+        FillHLine(pos + Vector2D<int>{ 0, dy }, size.x, c);
+    }
+}
+
+void
+PixelWriter::WriteMaskedRow(Vector2D<int> pos, uint8_t bits, const PixelColor& c) {
+    for (int dx = 0; dx < 8; ++dx) {
+        if ((bits << dx) & 0x80u) {
+            Write(pos + Vector2D<int>{ dx, 0 }, c);
+        }
+    }
+}
+
+void
+PixelWriter::WriteGlyph(Vector2D<int> pos, const NativeGlyph& glyph) {
+    for (int dy = 0; dy < NativeGlyph::kHeight; ++dy) {
+        for (int dx = glyph.begin; dx < glyph.end; ++dx) {
+            if ((glyph.masks[dy] << dx) & 0x80u) {
+                Write(pos + Vector2D<int>{ dx, dy },
+                      FromNativePixel(glyph.format, glyph.pixels[dy][dx]));
+            }
+        }
+    }
+}
+
+void
+FrameBufferWriter::WriteGlyph(Vector2D<int> pos, const NativeGlyph& glyph) {
+    if (glyph.format != config_.pixel_format) {
+        PixelWriter::WriteGlyph(pos, glyph);
+        return;
+    }
+
+    auto row = reinterpret_cast<uint32_t*>(PixelAt(pos));
+    for (int dy = 0; dy < NativeGlyph::kHeight; ++dy) {
+        const uint8_t mask = glyph.masks[dy];
+        if (mask == 0xffu) {
+            Copy32(row, glyph.pixels[dy], NativeGlyph::kWidth);
+        } else if (mask && cached_) {
+            // 分岐せずにマスクで選択する 点の無い列は初めから触らない
+            const uint32_t* lanes = kFontLaneMasks[mask];
+            for (int dx = glyph.begin; dx < glyph.end; ++dx) {
+                row[dx] ^= (row[dx] ^ glyph.pixels[dy][dx]) & lanes[dx];
+            }
+        } else if (mask) {
+            // 画面のフレームバッファは読み出しが遅いので、点のあるピクセルだけを書き込む
+            for (int dx = glyph.begin; dx < glyph.end; ++dx) {
+                if ((mask << dx) & 0x80u) {
+                    row[dx] = glyph.pixels[dy][dx];
+                }
+            }
+        }
+        row += config_.pixels_per_scan_line;
+    }
+}
+
 void
-RGBResv8BitPerColorPixelWriter::Write(Vector2D<int> pos, const PixelColor& c) {
-    // x,y座標に色情報を書き込む
-    auto p = PixelAt(pos);
-    p[0] = c.r;
-    p[1] = c.g;
-    p[2] = c.b;
+FrameBufferWriter::FillNative(Vector2D<int> pos, Vector2D<int> size, uint32_t native) {
+    auto row = reinterpret_cast<uint32_t*>(PixelAt(pos));
+    for (int dy = 0; dy < size.y; ++dy) {
+        Fill32(row, native, size.x);
+        row += config_.pixels_per_scan_line;
+    }
 }
 
-// BGR形式で8ビットごとに予約しているピクセル情報を書き込む
 void
-BGRResv8BitPerColorPixelWriter::Write(Vector2D<int> pos, const PixelColor& c) {
-    // x,y座標に色情報を書き込む
-    auto p = PixelAt(pos);
-    p[0] = c.b;
-    p[1] = c.g;
-    p[2] = c.r;
+FrameBufferWriter::WriteMaskedNative(Vector2D<int> pos, uint8_t bits, uint32_t native) {
+    auto p = reinterpret_cast<uint32_t*>(PixelAt(pos));
+    if (!cached_) {
+        // 画面のフレームバッファは読み出しが遅いので、点のあるピクセルだけを書き込む
+        for (int dx = 0; dx < 8; ++dx) {
+            if ((bits << dx) & 0x80u) {
+                p[dx] = native;
+            }
+        }
+        return;
+    }
+
+    const uint32_t* lanes = kFontLaneMasks[bits];
+    for (int dx = 0; dx < 8; ++dx) {
+        p[dx] ^= (p[dx] ^ native) & lanes[dx];
+    }
 }
 
 void
@@ -25,14 +101,13 @@ DrawRectangle(PixelWriter& writer,
               const Vector2D<int>& pos,
               const Vector2D<int>& size,
               const PixelColor& c) {
-    for (int dx = 0; dx < size.x; ++dx) {
-        writer.Write(pos + Vector2D<int>{ dx, 0 }, c);
-        writer.Write(pos + Vector2D<int>{ dx, size.y - 1 }, c);
-    }
-    for (int dy = 1; dy < size.y - 1; ++dy) {
-        writer.Write(pos + Vector2D<int>{ 0, dy }, c);
-        writer.Write(pos + Vector2D<int>{ size.x - 1, dy }, c);
+    if (size.x <= 0 || size.y <= 0) {
+        return;
     }
+    writer.FillHLine(pos, size.x, c);
+    writer.FillHLine(pos + Vector2D<int>{ 0, size.y - 1 }, size.x, c);
+    writer.FillRect(pos + Vector2D<int>{ 0, 1 }, { 1, size.y - 2 }, c);
+    writer.FillRect(pos + Vector2D<int>{ size.x - 1, 1 }, { 1, size.y - 2 }, c);
 }
 
 void
@@ -40,11 +115,10 @@ FillRectangle(PixelWriter& writer,
               const Vector2D<int>& pos,
               const Vector2D<int>& size,
               const PixelColor& c) {
-    for (int dy = 0; dy < size.y; ++dy) {
-        for (int dx = 0; dx < size.x; ++dx) {
-            writer.Write(pos + Vector2D<int>{ dx, dy }, c);
-        }
+    if (size.x <= 0 || size.y <= 0) {
+        return;
     }
+    writer.FillRect(pos, size, c);
 }
 
 void
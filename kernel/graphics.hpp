@@ -2,6 +2,7 @@
 
 #include "frame_buffer_config.hpp"
 #include <algorithm>
+#include <optional>
 
 // ピクセルの色情報
 struct PixelColor {
@@ -49,6 +50,16 @@ struct Vector2D {
         tmp -= rhs;
         return tmp;
     }
+
+    template<typename U>
+    bool operator==(const Vector2D<U>& rhs) const {
+        return x == rhs.x && y == rhs.y;
+    }
+
+    template<typename U>
+    bool operator!=(const Vector2D<U>& rhs) const {
+        return !(*this == rhs);
+    }
 };
 
 template<typename T>
@@ -83,6 +94,43 @@ operator&(const Rectangle<T>& lhs, const Rectangle<U>& rhs) {
     return { new_pos, new_size };
 }
 
+// lhs と rhs の両方を含む最小の矩形を返す 大きさが0の矩形は無視する
+template<typename T>
+Rectangle<T>
+operator|(const Rectangle<T>& lhs, const Rectangle<T>& rhs) {
+    if (lhs.size.x <= 0 || lhs.size.y <= 0) {
+        return rhs;
+    }
+    if (rhs.size.x <= 0 || rhs.size.y <= 0) {
+        return lhs;
+    }
+    const auto new_pos = ElementMin(lhs.pos, rhs.pos);
+    const auto new_end = ElementMax(lhs.pos + lhs.size, rhs.pos + rhs.size);
+    return { new_pos, new_end - new_pos };
+}
+
+// outer が inner を完全に含んでいれば true を返す
+template<typename T>
+bool
+Contains(const Rectangle<T>& outer, const Rectangle<T>& inner) {
+    const auto outer_end = outer.pos + outer.size;
+    const auto inner_end = inner.pos + inner.size;
+    return outer.pos.x <= inner.pos.x && outer.pos.y <= inner.pos.y &&
+           inner_end.x <= outer_end.x && inner_end.y <= outer_end.y;
+}
+
+// 8x16 ピクセルの文字を、ピクセル形式 format の 32 ビット値に展開したもの
+struct NativeGlyph {
+    static const int kWidth = 8, kHeight = 16;
+
+    PixelFormat format;
+    uint32_t pixels[kHeight][kWidth];
+    // 各行で書き込むピクセル 最上位ビットが左端のピクセルに対応する
+    uint8_t masks[kHeight];
+    // 書き込むピクセルのある列の範囲 [begin, end)
+    uint8_t begin, end;
+};
+
 // ピクセル情報を書き込む
 class PixelWriter {
   public:
@@ -92,44 +140,152 @@ class PixelWriter {
     virtual void Write(Vector2D<int> pos, const PixelColor& c) = 0;
     virtual int Width() const = 0;
     virtual int Height() const = 0;
+
+    // 以下は複数ピクセルをまとめて書き込む操作
+    // 既定の実装は Write を繰り返すだけなので、派生クラスで最適化した実装に置き換える
+
+    // pos から右方向へ width ピクセルを色 c で塗る
+    virtual void FillHLine(Vector2D<int> pos, int width, const PixelColor& c);
+    // pos を左上とする size の矩形を色 c で塗る
+    virtual void FillRect(Vector2D<int> pos, Vector2D<int> size, const PixelColor& c);
+    // pos から右方向の 8 ピクセルのうち、bits の立っているビットに色 c を書く
+    // 最上位ビットが左端のピクセルに対応する
+    virtual void WriteMaskedRow(Vector2D<int> pos, uint8_t bits, const PixelColor& c);
+    // pos を左上として、展開済みの文字 glyph を書く
+    virtual void WriteGlyph(Vector2D<int> pos, const NativeGlyph& glyph);
+
+    // 書き込み先がピクセル形式を持つバッファならその形式を返す
+    // NativeGlyph はこの形式で展開しておくと変換なしに書き込める
+    virtual std::optional<PixelFormat> NativeFormat() const { return std::nullopt; }
 };
 
 class FrameBufferWriter : public PixelWriter {
   public:
-    FrameBufferWriter(const FrameBufferConfig& config)
-        : config_{ config } {}
+    // cached は書き込み先が通常のキャッシュされたメモリかどうか
+    // false なら WC などのフレームバッファとみなし、書き込みのために読み出すことはしない
+    FrameBufferWriter(const FrameBufferConfig& config, bool cached = false)
+        : config_{ config }
+        , cached_{ cached } {}
     virtual ~FrameBufferWriter() = default;
     virtual int Width() const override { return config_.horizontal_resolution; }
     virtual int Height() const override { return config_.vertical_resolution; }
+    virtual void WriteGlyph(Vector2D<int> pos, const NativeGlyph& glyph) override;
+    virtual std::optional<PixelFormat> NativeFormat() const override {
+        return config_.pixel_format;
+    }
+
+    // x,y座標のピクセルを読み出す
+    virtual PixelColor At(Vector2D<int> pos) const = 0;
 
   protected:
     // x,y座標のピクセルへのポインタを返す
-    uint8_t* PixelAt(Vector2D<int> pos) {
+    uint8_t* PixelAt(Vector2D<int> pos) const {
         return config_.frame_buffer + 4 * (config_.pixels_per_scan_line * pos.y + pos.x);
     }
 
+    // フレームバッファ形式に変換済みの 32 ビット値 native で矩形を塗る
+    void FillNative(Vector2D<int> pos, Vector2D<int> size, uint32_t native);
+    // フレームバッファ形式に変換済みの 32 ビット値 native でマスクされた 8 ピクセルを書く
+    void WriteMaskedNative(Vector2D<int> pos, uint8_t bits, uint32_t native);
+
   private:
     const FrameBufferConfig& config_;
+    const bool cached_;
 };
 
-// RGB形式で8ビットごとに予約しているピクセル情報を書き込む
-class RGBResv8BitPerColorPixelWriter : public FrameBufferWriter {
-  public:
-    using FrameBufferWriter::FrameBufferWriter;
+// ピクセル形式ごとの配置情報
+// ピクセルあたりのバイト数と各チャネルのバイトオフセットをコンパイル時定数として持つ
+template<PixelFormat F>
+struct PixelFormatTraits;
 
-    // x,y座標に色情報を書き込む
-    virtual void Write(Vector2D<int> pos, const PixelColor& c) override;
+template<>
+struct PixelFormatTraits<kPixelRGBResv8BitPerColor> {
+    static constexpr int kBytesPerPixel = 4;
+    static constexpr int kROffset = 0, kGOffset = 1, kBOffset = 2;
 };
 
-// BGR形式で8ビットごとに予約しているピクセル情報を書き込む
-class BGRResv8BitPerColorPixelWriter : public FrameBufferWriter {
+template<>
+struct PixelFormatTraits<kPixelBGRResv8BitPerColor> {
+    static constexpr int kBytesPerPixel = 4;
+    static constexpr int kROffset = 2, kGOffset = 1, kBOffset = 0;
+};
+
+// 色情報をピクセル形式 F の 32 ビット値に変換する
+template<PixelFormat F>
+constexpr uint32_t
+ToNativePixel(const PixelColor& c) {
+    using Traits = PixelFormatTraits<F>;
+    return static_cast<uint32_t>(c.r) << (8 * Traits::kROffset) |
+           static_cast<uint32_t>(c.g) << (8 * Traits::kGOffset) |
+           static_cast<uint32_t>(c.b) << (8 * Traits::kBOffset);
+}
+
+// ピクセル形式 F の 32 ビット値を色情報に変換する
+template<PixelFormat F>
+constexpr PixelColor
+FromNativePixel(uint32_t v) {
+    using Traits = PixelFormatTraits<F>;
+    return { static_cast<uint8_t>(v >> (8 * Traits::kROffset)),
+             static_cast<uint8_t>(v >> (8 * Traits::kGOffset)),
+             static_cast<uint8_t>(v >> (8 * Traits::kBOffset)) };
+}
+
+// 実行時に与えられたピクセル形式で色情報を 32 ビット値に変換する
+inline uint32_t
+ToNativePixel(PixelFormat format, const PixelColor& c) {
+    switch (format) {
+        case kPixelRGBResv8BitPerColor:
+            return ToNativePixel<kPixelRGBResv8BitPerColor>(c);
+        case kPixelBGRResv8BitPerColor:
+            return ToNativePixel<kPixelBGRResv8BitPerColor>(c);
+    }
+    return 0;
+}
+
+// 実行時に与えられたピクセル形式の 32 ビット値を色情報に変換する
+inline PixelColor
+FromNativePixel(PixelFormat format, uint32_t v) {
+    switch (format) {
+        case kPixelRGBResv8BitPerColor:
+            return FromNativePixel<kPixelRGBResv8BitPerColor>(v);
+        case kPixelBGRResv8BitPerColor:
+            return FromNativePixel<kPixelBGRResv8BitPerColor>(v);
+    }
+    return { 0, 0, 0 };
+}
+
+// ピクセル形式 F のフレームバッファにピクセル情報を書き込む
+// 形式はコンパイル時に決まるので、各操作は分岐なしで 32 ビット値を書き込むだけになる
+template<PixelFormat F>
+class PixelFormatWriter : public FrameBufferWriter {
   public:
+    static_assert(PixelFormatTraits<F>::kBytesPerPixel == 4);
+
     using FrameBufferWriter::FrameBufferWriter;
 
     // x,y座標に色情報を書き込む
-    virtual void Write(Vector2D<int> pos, const PixelColor& c) override;
+    virtual void Write(Vector2D<int> pos, const PixelColor& c) override {
+        *reinterpret_cast<uint32_t*>(PixelAt(pos)) = ToNativePixel<F>(c);
+    }
+    virtual PixelColor At(Vector2D<int> pos) const override {
+        return FromNativePixel<F>(*reinterpret_cast<const uint32_t*>(PixelAt(pos)));
+    }
+    virtual void FillHLine(Vector2D<int> pos, int width, const PixelColor& c) override {
+        FillNative(pos, { width, 1 }, ToNativePixel<F>(c));
+    }
+    virtual void FillRect(Vector2D<int> pos, Vector2D<int> size, const PixelColor& c) override {
+        FillNative(pos, size, ToNativePixel<F>(c));
+    }
+    virtual void WriteMaskedRow(Vector2D<int> pos, uint8_t bits, const PixelColor& c) override {
+        WriteMaskedNative(pos, bits, ToNativePixel<F>(c));
+    }
 };
 
+// RGB形式で8ビットごとに予約しているピクセル情報を書き込む
+using RGBResv8BitPerColorPixelWriter = PixelFormatWriter<kPixelRGBResv8BitPerColor>;
+// BGR形式で8ビットごとに予約しているピクセル情報を書き込む
+using BGRResv8BitPerColorPixelWriter = PixelFormatWriter<kPixelBGRResv8BitPerColor>;
+
 void
 DrawRectangle(PixelWriter& writer,
               const Vector2D<int>& pos,
@@ -0,0 +1,120 @@
+/**
+ * @file idle.cpp
+ *
+ * hlt または monitor/mwait による待機と、その統計のプログラムを集めたファイル
+ */
+
+#include "idle.hpp"
+
+#include <cpuid.h>
+
+#include "asmfunc.h"
+#include "trace.hpp"
+
+namespace {
+    const uint32_t kCPUID1ECXMonitor = 1u << 3;
+    /** @brief CPUID.05H:ECX bit 0 mwait の ECX で拡張を指定できる */
+    const uint32_t kCPUID5ECXExtensions = 1u << 0;
+    /** @brief CPUID.05H:ECX bit 1 割り込み禁止中でも割り込みで mwait から復帰できる */
+    const uint32_t kCPUID5ECXInterruptBreak = 1u << 1;
+    /** @brief mwait の ECX bit 0 割り込みが禁止されていても割り込みで復帰する */
+    const uint32_t kMWaitInterruptBreak = 1u << 0;
+
+    IdleMode idle_mode = IdleMode::kHlt;
+    /**
+     * @brief monitor で見張るキャッシュライン
+     *
+     * 復帰のきっかけは割り込みだけなので、誰も書き込まない専用の領域を見張る
+     */
+    alignas(64) volatile uint8_t monitor_line[64];
+
+    /** @brief Idle で停止している間は true 割り込みハンドラからも読む */
+    volatile bool idling = false;
+    /** @brief 停止中に最初に入った割り込みハンドラの TSC 0 ならまだ入っていない */
+    volatile uint64_t wakeup_tsc = 0;
+
+    uint64_t init_tsc = 0;
+    uint64_t idle_time = 0, wakeups = 0;
+    uint64_t total_resume_time = 0, max_resume_time = 0;
+
+    /**
+     * @brief 割り込み禁止のまま mwait で待ち、割り込みで復帰できるか調べる
+     *
+     * monitor/mwait 自体の対応に加え、leaf 5 で kMWaitInterruptBreak の拡張の対応を確かめる
+     */
+    bool CanMWaitWithInterruptBreak() {
+        unsigned int eax, ebx, ecx, edx;
+        __cpuid(1, eax, ebx, ecx, edx);
+        if ((ecx & kCPUID1ECXMonitor) == 0 || __get_cpuid_max(0, nullptr) < 5) {
+            return false;
+        }
+
+        __cpuid(5, eax, ebx, ecx, edx);
+        const uint32_t required = kCPUID5ECXExtensions | kCPUID5ECXInterruptBreak;
+        return (ecx & required) == required;
+    }
+}
+
+void
+InitializeIdle(IdleMode preferred) {
+    idle_mode = preferred == IdleMode::kMWait && CanMWaitWithInterruptBreak() ? IdleMode::kMWait
+                                                                              : IdleMode::kHlt;
+    init_tsc = ReadTSC();
+}
+
+IdleMode
+CurrentIdleMode() {
+    return idle_mode;
+}
+
+void
+Idle() {
+    wakeup_tsc = 0;
+    idling = true;
+    const uint64_t begin = ReadTSC();
+    Trace(kTraceIdleBegin);
+
+    if (idle_mode == IdleMode::kMWait) {
+        // 割り込み禁止のまま待ち、復帰してから割り込みを許可してハンドラを動かす
+        Monitor(const_cast<const uint8_t*>(monitor_line));
+        MWait(0, kMWaitInterruptBreak);
+        // sti の直後の1命令は割り込まれないので、nop を挟んでここで保留中の割り込みを受け付ける
+        // そうしないと次の cli までハンドラが動かず、idling を戻した後に回ってしまう
+        __asm__ volatile("sti\n\tnop" ::: "memory");
+    } else {
+        // 割り込みハンドラが動いた後に hlt から戻る
+        StiHlt();
+    }
+
+    __asm__("cli");
+    idling = false;
+    const uint64_t end = ReadTSC();
+    __asm__("sti");
+
+    // 停止していた時間は最初の割り込みハンドラに入るまでとし、ハンドラの実行時間は含めない
+    idle_time += (wakeup_tsc != 0 ? wakeup_tsc : end) - begin;
+    // 復帰時間はハンドラの実行時間を含む hlt はハンドラが戻るまで復帰しないので、分けて測れない
+    if (wakeup_tsc != 0) {
+        const uint64_t resume_time = end - wakeup_tsc;
+        ++wakeups;
+        total_resume_time += resume_time;
+        if (resume_time > max_resume_time) {
+            max_resume_time = resume_time;
+        }
+    }
+    Trace(kTraceIdleEnd, end - begin);
+}
+
+void __attribute__((no_caller_saved_registers))
+NotifyIdleWakeup() {
+    if (idling && wakeup_tsc == 0) {
+        wakeup_tsc = ReadTSC();
+    }
+}
+
+IdleStats
+GetIdleStats() {
+    return {
+        ReadTSC() - init_tsc, idle_time, wakeups, total_resume_time, max_resume_time,
+    };
+}
@@ -0,0 +1,68 @@
+/**
+ * @file idle.hpp
+ *
+ * メインループに処理すべきメッセージが無い間、CPU を停止させて待つためのプログラム
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief 0 以外なら、使えるときは hlt の代わりに monitor/mwait で待つ
+ *
+ * make IDLE_MWAIT=1 のように指定して変える
+ */
+#ifndef IDLE_MWAIT
+#define IDLE_MWAIT 0
+#endif
+
+enum class IdleMode {
+    kHlt,
+    kMWait,
+};
+
+/** @brief 待機の統計 時間は TSC のカウント数 */
+struct IdleStats {
+    /** @brief InitializeIdle からの経過時間 */
+    uint64_t total_time;
+    /** @brief そのうち CPU を停止していた時間 復帰させた割り込みハンドラの実行時間は含まない */
+    uint64_t idle_time;
+    uint64_t wakeups;
+    /**
+     * @brief 最初の割り込みハンドラに入ってから Idle を抜けるまでの時間の合計と最大
+     *
+     * 割り込みが来てからハンドラに入るまでの遅れは測れないので含まない
+     * 逆に、復帰させた割り込みハンドラの実行時間は含む
+     */
+    uint64_t total_resume_time;
+    uint64_t max_resume_time;
+};
+
+/**
+ * @brief 待機の方法を選ぶ
+ *
+ * kMWait を指定しても、CPU が monitor/mwait と、割り込み禁止中に割り込みで mwait から
+ * 復帰する拡張 (CPUID.05H:ECX[1]) に対応していなければ kHlt を使う
+ */
+void
+InitializeIdle(IdleMode preferred);
+/** @brief InitializeIdle で選んだ待機の方法を返す */
+IdleMode
+CurrentIdleMode();
+
+/**
+ * @brief 割り込みが来るまで CPU を停止させる
+ *
+ * 割り込みを禁止した状態で呼び、割り込みを許可した状態で戻る
+ * 呼び出し元は割り込みを禁止したまま待機の条件を確かめるので、その後に来た割り込みを取りこぼさない
+ */
+void
+Idle();
+
+/** @brief 割り込みハンドラの先頭で呼び、ハンドラに入った時刻を IdleStats の復帰時間の起点にする */
+void __attribute__((no_caller_saved_registers))
+NotifyIdleWakeup();
+
+IdleStats
+GetIdleStats();
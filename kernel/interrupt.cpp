@@ -7,6 +7,7 @@
 #include "interrupt.hpp"
 
 std::array<InterruptDescriptor, 256> idt;
+int interrupt_depth = 0;
 
 void
 SetIDTEntry(InterruptDescriptor& desc,
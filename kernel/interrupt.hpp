@@ -56,6 +56,8 @@ class InterruptVector {
   public:
     enum Number {
         kXHCI = 0x40,
+        kSerial = 0x41,
+        kLAPICTimer = 0x42,
     };
 };
 
@@ -68,3 +70,25 @@ struct InterruptFrame {
 };
 
 void __attribute__((no_caller_saved_registers)) NotifyEndOfInterrupt();
+
+/** @brief 実行中の割り込みハンドラの数 InterruptScope で増減する */
+extern int interrupt_depth;
+
+/**
+ * @brief 割り込みハンドラの実行中であることを記録する
+ *
+ * 各割り込みハンドラの先頭で生成し、呼び出した関数が InInterrupt で調べられるようにする
+ */
+class InterruptScope {
+  public:
+    InterruptScope() { ++interrupt_depth; }
+    ~InterruptScope() { --interrupt_depth; }
+    InterruptScope(const InterruptScope&) = delete;
+    InterruptScope& operator=(const InterruptScope&) = delete;
+};
+
+/** @brief 割り込みハンドラの中から呼ばれたなら true を返す */
+inline bool
+InInterrupt() {
+    return interrupt_depth > 0;
+}
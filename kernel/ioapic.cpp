@@ -0,0 +1,48 @@
+/**
+ * @file ioapic.cpp
+ *
+ * I/O APIC を使って ISA の割り込みを Local APIC へ届けるプログラムを集めたファイル
+ */
+
+#include "ioapic.hpp"
+
+#include "asmfunc.h"
+
+namespace {
+    const uint32_t kIOAPICVersion = 0x01;
+    const uint32_t kIOAPICRedirectionTable = 0x10;
+    const uint32_t kRedirectionMasked = 1u << 16;
+
+    const uint16_t kPIC1Data = 0x21;
+    const uint16_t kPIC2Data = 0xa1;
+
+    uint32_t ReadIOAPIC(uint32_t reg) {
+        *reinterpret_cast<volatile uint32_t*>(kIOAPICBase) = reg;        // IOREGSEL
+        return *reinterpret_cast<volatile uint32_t*>(kIOAPICBase + 0x10); // IOWIN
+    }
+
+    void WriteIOAPIC(uint32_t reg, uint32_t value) {
+        *reinterpret_cast<volatile uint32_t*>(kIOAPICBase) = reg;
+        *reinterpret_cast<volatile uint32_t*>(kIOAPICBase + 0x10) = value;
+    }
+}
+
+void
+InitializeIOAPIC() {
+    // 8259 PIC からの割り込みは使わないので、すべてマスクする
+    IoOut8(kPIC1Data, 0xff);
+    IoOut8(kPIC2Data, 0xff);
+
+    const int num_entries = ((ReadIOAPIC(kIOAPICVersion) >> 16) & 0xff) + 1;
+    for (int i = 0; i < num_entries; ++i) {
+        WriteIOAPIC(kIOAPICRedirectionTable + 2 * i, kRedirectionMasked);
+        WriteIOAPIC(kIOAPICRedirectionTable + 2 * i + 1, 0);
+    }
+}
+
+void
+RouteISAInterrupt(uint8_t irq, uint8_t vector, uint8_t apic_id) {
+    // 上位 32 ビットの宛先を先に書き、最後にマスクを外す
+    WriteIOAPIC(kIOAPICRedirectionTable + 2 * irq + 1, static_cast<uint32_t>(apic_id) << 24);
+    WriteIOAPIC(kIOAPICRedirectionTable + 2 * irq, vector); // Fixed, Physical, Edge, High
+}
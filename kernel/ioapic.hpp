@@ -0,0 +1,29 @@
+/**
+ * @file ioapic.hpp
+ *
+ * I/O APIC を使って ISA の割り込みを Local APIC へ届けるプログラムを集めたファイル
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/** @brief I/O APIC のレジスタの物理アドレス */
+const uintptr_t kIOAPICBase = 0xfec00000;
+
+/**
+ * @brief 8259 PIC を無効にし、I/O APIC のすべての割り込みをマスクする
+ *
+ * ISA の割り込みは RouteISAInterrupt で個別に有効にする
+ */
+void
+InitializeIOAPIC();
+
+/**
+ * @brief ISA の IRQ を指定した Local APIC のベクタへ届ける
+ *
+ * エッジトリガ、アクティブハイで設定する IRQ 番号と I/O APIC の入力が
+ * 一致していること (ACPI の Interrupt Source Override が無いこと) を前提とする
+ */
+void
+RouteISAInterrupt(uint8_t irq, uint8_t vector, uint8_t apic_id);
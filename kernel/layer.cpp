@@ -2,6 +2,8 @@
 
 #include <algorithm>
 
+#include "trace.hpp"
+
 Layer::Layer(unsigned int id)
     : id_{ id } {}
 
@@ -37,6 +39,11 @@ Layer::IsDraggable() const {
     return draggable_;
 }
 
+bool
+Layer::IsOpaque() const {
+    return window_ && window_->IsOpaque();
+}
+
 Layer&
 Layer::Move(Vector2D<int> pos) {
     pos_ = pos;
@@ -50,19 +57,23 @@ Layer::MoveRelative(Vector2D<int> pos_diff) {
 }
 
 void
-Layer::DrawTo(FrameBuffer& screen, const Rectangle<int>& area) const {
+Layer::DrawTo(FrameBuffer& screen, const Rectangle<int>& area, const Blitter& blitter) const {
     if (window_) {
-        window_->DrawTo(screen, pos_, area);
+        window_->DrawTo(screen, pos_, area, blitter);
     }
 }
 
-void
+Error
 LayerManager::SetWriter(FrameBuffer* screen) {
+    blitter_ = GetBlitter(screen->Config().pixel_format);
+    if (blitter_ == nullptr) {
+        return MAKE_ERROR(Error::kUnknownPixelFormat);
+    }
     screen_ = screen;
 
     FrameBufferConfig back_config = screen->Config();
     back_config.frame_buffer = nullptr;
-    back_buffer_.Initialize(back_config);
+    return back_buffer_.Initialize(back_config);
 }
 
 Layer&
@@ -73,47 +84,91 @@ LayerManager::NewLayer() {
 
 void
 LayerManager::Draw(const Rectangle<int>& area) const {
-    for (auto layer : layer_stack_) {
-        layer->DrawTo(back_buffer_, area);
-    }
-    screen_->Copy(area.pos, back_buffer_, area);
+    Compose(area, 0);
 }
 
 void
 LayerManager::Draw(unsigned int id) const {
-    bool draw = false;
-    Rectangle<int> window_area;
-    for (auto layer : layer_stack_) {
-        if (layer->ID() == id) {
-            window_area.size = layer->GetWindow()->Size();
-            window_area.pos = layer->GetPosition();
-            draw = true;
+    auto pred = [id](Layer* layer) { return layer->ID() == id; };
+    auto it = std::find_if(layer_stack_.begin(), layer_stack_.end(), pred);
+    if (it == layer_stack_.end()) {
+        return;
+    }
+    Compose(LayerArea(**it), it - layer_stack_.begin());
+}
+
+void
+LayerManager::Invalidate(const Rectangle<int>& area) {
+    dirty_.Union(area);
+}
+
+void
+LayerManager::Flush() {
+    Trace(kTraceLayerFlushBegin);
+    for (auto it = layer_stack_.begin(); it != layer_stack_.end(); ++it) {
+        const auto window = (*it)->GetWindow();
+        if (!window || !window->HasDamage()) {
+            continue;
         }
-        if (draw) {
-            layer->DrawTo(back_buffer_, window_area);
+        const auto damage = window->TakeDamage();
+        Region area{ { damage.pos + (*it)->GetPosition(), damage.size } };
+        for (auto upper = it + 1; upper != layer_stack_.end() && !area.IsEmpty(); ++upper) {
+            if ((*upper)->IsOpaque()) {
+                area.Subtract(LayerArea(**upper));
+            }
         }
+        dirty_.Union(area);
+    }
+
+    dirty_.Intersect(ScreenArea());
+    Compose(dirty_, 0);
+    Trace(kTraceLayerFlushEnd, dirty_.Rects().size());
+    dirty_.Clear();
+
+    if (!cursor_) {
+        return;
+    }
+    bool cursor_changed = cursor_pos_ != cursor_shown_pos_;
+    if (cursor_->HasDamage()) {
+        cursor_->TakeDamage();
+        cursor_changed = true;
+    }
+    if (!cursor_changed) {
+        return;
+    }
+
+    // 移動前の範囲はバックバッファの内容で元に戻し、移動後の範囲にカーソルを描く
+    // 2つが重なるなら、まとめて1回で転送する
+    const auto old_area = CursorArea(cursor_shown_pos_);
+    const auto new_area = CursorArea(cursor_pos_);
+    uint64_t presented = 0;
+    if (IsEmpty(old_area & new_area)) {
+        PresentWithCursor(old_area);
+        PresentWithCursor(new_area);
+        presented = old_area.size.x * old_area.size.y + new_area.size.x * new_area.size.y;
+    } else {
+        const auto area = old_area | new_area;
+        PresentWithCursor(area);
+        presented = area.size.x * area.size.y;
     }
-    screen_->Copy(window_area.pos, back_buffer_, window_area);
+    cursor_shown_pos_ = cursor_pos_;
+    Trace(kTraceCursorUpdate, presented);
 }
 
 void
 LayerManager::Move(unsigned int id, Vector2D<int> new_pos) {
     auto layer = FindLayer(id);
-    const auto window_size = layer->GetWindow()->Size();
-    const auto old_pos = layer->GetPosition();
+    Invalidate(LayerArea(*layer));
     layer->Move(new_pos);
-    Draw({ old_pos, window_size });
-    Draw(id);
+    Invalidate(LayerArea(*layer));
 }
 
 void
 LayerManager::MoveRelative(unsigned int id, Vector2D<int> pos_diff) {
     auto layer = FindLayer(id);
-    const auto window_size = layer->GetWindow()->Size();
-    const auto old_pos = layer->GetPosition();
+    Invalidate(LayerArea(*layer));
     layer->MoveRelative(pos_diff);
-    Draw({ old_pos, window_size });
-    Draw(id);
+    Invalidate(LayerArea(*layer));
 }
 
 void
@@ -129,6 +184,7 @@ LayerManager::UpDown(unsigned int id, int new_height) {
     auto layer = FindLayer(id);
     auto old_pos = std::find(layer_stack_.begin(), layer_stack_.end(), layer);
     auto new_pos = layer_stack_.begin() + new_height;
+    Invalidate(LayerArea(*layer));
 
     if (old_pos == layer_stack_.end()) {
         layer_stack_.insert(new_pos, layer);
@@ -148,9 +204,39 @@ LayerManager::Hide(unsigned int id) {
     auto pos = std::find(layer_stack_.begin(), layer_stack_.end(), layer);
     if (pos != layer_stack_.end()) {
         layer_stack_.erase(pos);
+        Invalidate(LayerArea(*layer));
     }
 }
 
+Error
+LayerManager::SetCursor(const std::shared_ptr<Window>& cursor, Vector2D<int> pos) {
+    if (cursor_) {
+        Invalidate(CursorArea(cursor_shown_pos_));
+        cursor_.reset();
+    }
+    if (!cursor) {
+        return MAKE_ERROR(Error::kSuccess);
+    }
+
+    FrameBufferConfig scratch_config = screen_->Config();
+    scratch_config.frame_buffer = nullptr;
+    scratch_config.horizontal_resolution = cursor->Width() * 2;
+    scratch_config.vertical_resolution = cursor->Height() * 2;
+    if (auto err = cursor_scratch_.Initialize(scratch_config)) {
+        return err;
+    }
+
+    cursor_ = cursor;
+    cursor_pos_ = cursor_shown_pos_ = pos;
+    Invalidate(CursorArea(cursor_pos_));
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+void
+LayerManager::MoveCursor(Vector2D<int> pos) {
+    cursor_pos_ = pos;
+}
+
 Layer*
 LayerManager::FindLayerByPosition(Vector2D<int> pos, unsigned int exclude_id) const {
     auto pred = [pos, exclude_id](Layer* layer) {
@@ -183,4 +269,90 @@ LayerManager::FindLayer(unsigned int id) {
     return it->get();
 }
 
+Rectangle<int>
+LayerManager::LayerArea(const Layer& layer) const {
+    const auto window = layer.GetWindow();
+    if (!window) {
+        return {};
+    }
+    return { layer.GetPosition(), window->Size() };
+}
+
+void
+LayerManager::Compose(const Region& area, size_t first) const {
+    if (area.IsEmpty()) {
+        return;
+    }
+    Trace(kTraceComposeBegin, area.Rects().size(), first);
+
+    std::vector<Region> visible(layer_stack_.size());
+    Region uncovered = area;
+    for (size_t i = layer_stack_.size(); i-- > first && !uncovered.IsEmpty();) {
+        const auto layer_area = LayerArea(*layer_stack_[i]);
+        visible[i] = uncovered;
+        visible[i].Intersect(layer_area);
+        if (layer_stack_[i]->IsOpaque()) {
+            uncovered.Subtract(layer_area);
+        }
+    }
+
+    for (size_t i = first; i < layer_stack_.size(); ++i) {
+        for (const auto& rect : visible[i].Rects()) {
+            layer_stack_[i]->DrawTo(back_buffer_, rect, *blitter_);
+        }
+    }
+    // カーソルと重なる範囲は、カーソルを重ねてから転送する
+    Region present = area;
+    Rectangle<int> cursor_area{};
+    if (cursor_) {
+        cursor_area = CursorArea(cursor_pos_);
+        Region under_cursor = area;
+        if (under_cursor.Intersect(cursor_area).IsEmpty()) {
+            cursor_area = {};
+        } else {
+            present.Subtract(cursor_area);
+        }
+    }
+
+    uint64_t presented = 0;
+    for (const auto& rect : present.Rects()) {
+        const int pixels = rect.size.x * rect.size.y;
+        if (pixels >= kStreamingPresentPixels) {
+            blitter_->copy_streaming(*screen_, rect.pos, back_buffer_, rect);
+        } else {
+            blitter_->copy(*screen_, rect.pos, back_buffer_, rect);
+        }
+        presented += pixels;
+    }
+    if (!IsEmpty(cursor_area)) {
+        PresentWithCursor(cursor_area);
+        presented += cursor_area.size.x * cursor_area.size.y;
+    }
+    Trace(kTraceComposeEnd, presented);
+}
+
+Rectangle<int>
+LayerManager::ScreenArea() const {
+    const auto& screen_config = screen_->Config();
+    return { { 0, 0 },
+             { static_cast<int>(screen_config.horizontal_resolution),
+               static_cast<int>(screen_config.vertical_resolution) } };
+}
+
+Rectangle<int>
+LayerManager::CursorArea(Vector2D<int> pos) const {
+    return Rectangle<int>{ pos, cursor_->Size() } & ScreenArea();
+}
+
+void
+LayerManager::PresentWithCursor(const Rectangle<int>& area) const {
+    if (IsEmpty(area)) {
+        return;
+    }
+    const Rectangle<int> scratch_area{ { 0, 0 }, area.size };
+    blitter_->copy(cursor_scratch_, { 0, 0 }, back_buffer_, area);
+    cursor_->DrawTo(cursor_scratch_, cursor_pos_ - area.pos, scratch_area, *blitter_);
+    blitter_->copy(*screen_, area.pos, cursor_scratch_, scratch_area);
+}
+
 LayerManager* layer_manager;
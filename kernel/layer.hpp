@@ -11,6 +11,7 @@
 #include <vector>
 
 #include "graphics.hpp"
+#include "region.hpp"
 #include "window.hpp"
 
 /**
@@ -36,6 +37,8 @@ class Layer {
     Layer& SetDraggable(bool graggable);
     /** @brief レイヤーがドラッグ移動可能なら true を返す。 */
     bool IsDraggable() const;
+    /** @brief ウィンドウが透過色を持たず、下のレイヤーを完全に覆い隠すなら true を返す */
+    bool IsOpaque() const;
 
     /** @brief レイヤーの位置情報を指定された絶対座標へと更新する 再描画はしない */
     Layer& Move(Vector2D<int> pos);
@@ -43,7 +46,7 @@ class Layer {
     Layer& MoveRelative(Vector2D<int> pos_diff);
 
     /** @brief 指定された描画先にウィンドウの内容を描画する */
-    void DrawTo(FrameBuffer& screen, const Rectangle<int>& area) const;
+    void DrawTo(FrameBuffer& screen, const Rectangle<int>& area, const Blitter& blitter) const;
 
   private:
     unsigned int id_;
@@ -55,8 +58,21 @@ class Layer {
 /** @brief LayerManagerは複数のレイヤーを管理する */
 class LayerManager {
   public:
-    /** @brief Drawメソッドなどで描画する際の描画先を設定する */
-    void SetWriter(FrameBuffer* screen);
+    /**
+     * @brief 画面への転送でキャッシュを汚さない書き込みを使い始める矩形のピクセル数
+     *
+     * これより小さい矩形は通常の書き込みで転送する
+     */
+    static const int kStreamingPresentPixels = 64 * 1024;
+
+    /**
+     * @brief Drawメソッドなどで描画する際の描画先を設定する
+     *
+     * 描画先のピクセル形式に特化した転送処理もここで選ぶ
+     * 各レイヤーのウィンドウは描画先と同じピクセル形式でなければならない
+     * 転送処理のないピクセル形式ならエラーを返し、描画先は変更しない
+     */
+    Error SetWriter(FrameBuffer* screen);
     /**
      * @brief 新しいレイヤーを生成して参照を返す
      *
@@ -64,14 +80,27 @@ class LayerManager {
      */
     Layer& NewLayer();
 
-    /** @brief 現在表示状態にあるレイヤーを描画する */
+    /**
+     * @brief 現在表示状態にあるレイヤーを描画する
+     *
+     * 不透明なレイヤーに覆われた部分はそれより下のレイヤーを描画しない
+     */
     void Draw(const Rectangle<int>& area) const;
     /** @brief 指定したレイヤーに設定されているウィンドウの描画領域内を再描画する */
     void Draw(unsigned int id) const;
+    /** @brief 指定された範囲を次の Flush で再描画する */
+    void Invalidate(const Rectangle<int>& area);
+    /**
+     * @brief 再描画が必要な範囲をまとめて1回だけ合成し、画面へ反映する
+     *
+     * Invalidate された範囲と、表示中の各ウィンドウで書き換えられた範囲を1つの Region に集める
+     * ウィンドウの書き換えのうち、上位の不透明なレイヤーに隠れている部分は除く
+     */
+    void Flush();
 
-    /** @brief レイヤーの位置情報を指定された絶対座標へと更新する 再描画する */
+    /** @brief レイヤーの位置情報を指定された絶対座標へと更新する 移動前後の範囲は次の Flush で再描画する */
     void Move(unsigned int id, Vector2D<int> new_pos);
-    /** @brief レイヤーの位置情報を指定された相対座標へと更新する 再描画する */
+    /** @brief レイヤーの位置情報を指定された相対座標へと更新する 移動前後の範囲は次の Flush で再描画する */
     void MoveRelative(unsigned int id, Vector2D<int> pos_diff);
 
     /**
@@ -85,17 +114,62 @@ class LayerManager {
     /** @brief レイヤーを非表示とする */
     void Hide(unsigned int id);
 
+    /**
+     * @brief マウスカーソルとして全レイヤーの上に重ねるウィンドウを設定する
+     *
+     * カーソルはレイヤーとしては合成せず、バックバッファの内容に重ねて画面へ直接描く
+     * カーソルの下の画素はバックバッファに残っているので、移動しても他のレイヤーは合成し直さない
+     * カーソルを重ねるための作業領域を用意できなければエラーを返し、カーソルは表示しない
+     */
+    Error SetCursor(const std::shared_ptr<Window>& cursor, Vector2D<int> pos);
+    /**
+     * @brief カーソルを指定された絶対座標へ移動する
+     *
+     * 次の Flush で移動前後の範囲だけをバックバッファから画面へ転送し直す
+     */
+    void MoveCursor(Vector2D<int> pos);
+
     /** @brief 指定された座標にウィンドウを持つ最も上に表示されているレイヤーを探す。 */
     Layer* FindLayerByPosition(Vector2D<int> pos, unsigned int exclude_id) const;
 
   private:
     FrameBuffer* screen_{ nullptr };
     mutable FrameBuffer back_buffer_{};
+    /** @brief 画面のピクセル形式に合わせて SetWriter で選んだ転送処理 */
+    const Blitter* blitter_{ nullptr };
+    /** @brief 次の Flush で再描画する範囲 */
+    Region dirty_{};
     std::vector<std::unique_ptr<Layer>> layers_{};
     std::vector<Layer*> layer_stack_{};
     unsigned int latest_id_{ 0 };
 
+    std::shared_ptr<Window> cursor_{};
+    /** @brief カーソルの位置と、画面に描かれているカーソルの位置 */
+    Vector2D<int> cursor_pos_{}, cursor_shown_pos_{};
+    /** @brief カーソルを重ねる作業領域 移動前後の範囲を覆えるようカーソルの縦横2倍の大きさを持つ */
+    mutable FrameBuffer cursor_scratch_{};
+
     Layer* FindLayer(unsigned int id);
+    /** @brief レイヤーのウィンドウが画面上で占める範囲を返す */
+    Rectangle<int> LayerArea(const Layer& layer) const;
+    /**
+     * @brief layer_stack_ の first 番目以降のレイヤーで area を合成し、画面へ反映する
+     *
+     * 上から順に不透明なレイヤーの範囲を area から除きながら各レイヤーの見える範囲を求め、
+     * 下から順にその範囲だけを描画する これにより各ピクセルはほぼ1回だけ書き込まれる
+     */
+    void Compose(const Region& area, size_t first) const;
+    /** @brief 画面全体の範囲を返す */
+    Rectangle<int> ScreenArea() const;
+    /** @brief pos に置いたカーソルが画面上で占める範囲を返す 画面外の部分は除く */
+    Rectangle<int> CursorArea(Vector2D<int> pos) const;
+    /**
+     * @brief バックバッファの area にカーソルを重ねて画面へ転送する
+     *
+     * 作業領域で重ねてから転送するので、カーソルが一瞬消えることはない
+     * area は作業領域に収まる大きさでなければならない
+     */
+    void PresentWithCursor(const Rectangle<int>& area) const;
 };
 
 extern LayerManager* layer_manager;
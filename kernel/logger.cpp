@@ -1,35 +1,270 @@
 #include "logger.hpp"
 
-#include <cstddef>
-#include <cstdio>
+#include <atomic>
+#include <cstring>
 
+#include "asmfunc.h"
 #include "console.hpp"
+#include "format.hpp"
+#include "interrupt.hpp"
+#include "serial.hpp"
+
+extern Console* console;
 
 namespace {
-    LogLevel log_level = kWarn;
+    /**
+     * @brief リングバッファ中の1レコードの先頭に置くヘッダ
+     *
+     * ヘッダの後ろに本文と終端の '\0' が続く
+     */
+    struct LogRecordHeader {
+        /** @brief ヘッダを含むレコードのバイト数 書き込みが完了するまで 0 のまま */
+        uint32_t size;
+        /** @brief 本文のバイト数 */
+        uint16_t length;
+        uint8_t level;
+        uint8_t subsystem;
+        uint64_t tsc;
+    };
+
+    /** @brief レコードの境界 ヘッダが必ず収まるよう、ヘッダの大きさに揃える */
+    const size_t kLogRecordAlign = sizeof(LogRecordHeader);
+    /** @brief リングバッファのバイト数 2 のべき乗とする */
+    const size_t kLogRingSize = 64 * 1024;
+    /** @brief 1レコードの本文の最大バイト数 ('\0' を含む) */
+    const size_t kMaxLogMessage = 256;
+    /** @brief リングバッファの末尾を埋めるだけで、出力しないレコードの level */
+    const uint8_t kPaddingLevel = 0;
+
+    alignas(kLogRecordAlign) uint8_t log_ring[kLogRingSize];
+    /**
+     * @brief 書き込み側が予約した位置と、読み出し側が読み終えた位置
+     *
+     * どちらも巻き戻らない通し番号で、リングバッファ上の位置は kLogRingSize で割った余り
+     */
+    std::atomic<uint64_t> reserve_pos{ 0 }, read_pos{ 0 };
+
+    std::atomic<uint64_t> records{ 0 }, dropped{ 0 }, truncated{ 0 };
+    std::atomic<size_t> max_used{ 0 };
+    /** @brief DrainLog の実行中なら true */
+    std::atomic<bool> draining{ false };
+    /** @brief 出力を DrainLog の呼び出しまで遅らせるなら true */
+    bool deferred = false;
+    /** @brief 前回 DrainLog が報告した時点での dropped */
+    uint64_t reported_drops = 0;
+    /** @brief シリアルポートへの出力が行の先頭にあれば true */
+    bool serial_line_start = true;
+
+    const char* const kLogSubsystemNames[kNumLogSubsystems] = {
+        "kernel", "usb", "pci", "gfx", "mem",
+    };
+
+    LogRecordHeader* RecordAt(uint64_t pos) {
+        return reinterpret_cast<LogRecordHeader*>(&log_ring[pos & (kLogRingSize - 1)]);
+    }
+
+    void UpdateMaxUsed(size_t used) {
+        size_t prev = max_used.load(std::memory_order_relaxed);
+        while (prev < used &&
+               !max_used.compare_exchange_weak(prev, used, std::memory_order_relaxed)) {
+        }
+    }
+
+    /** @brief ヘッダの各欄を書いてから size を書き込み、レコードを読み出し可能にする */
+    void Commit(LogRecordHeader* header, uint32_t size) {
+        __atomic_store_n(&header->size, size, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * @brief 本文 length バイトのレコードをリングバッファに予約する
+     *
+     * 複数の書き込み側が CAS で領域を予約し、予約した領域にだけ書き込む
+     * 末尾をまたぐレコードは作らず、末尾の残りは埋め草のレコードで埋める
+     * 予約したレコードは本文を書いた後に Publish で読み出し可能にする
+     *
+     * @return 予約したレコードのヘッダ 空きが無ければ nullptr
+     */
+    LogRecordHeader* Reserve(LogSubsystem subsystem, LogLevel level, size_t length) {
+        const size_t size =
+            (sizeof(LogRecordHeader) + length + 1 + kLogRecordAlign - 1) & ~(kLogRecordAlign - 1);
+
+        uint64_t head = reserve_pos.load(std::memory_order_relaxed);
+        uint64_t start, end;
+        do {
+            const size_t offset = head & (kLogRingSize - 1);
+            const size_t padding = offset + size > kLogRingSize ? kLogRingSize - offset : 0;
+            start = head + padding;
+            end = start + size;
+            if (end - read_pos.load(std::memory_order_acquire) > kLogRingSize) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+        } while (!reserve_pos.compare_exchange_weak(
+            head, end, std::memory_order_relaxed, std::memory_order_relaxed));
+
+        if (start != head) {
+            auto padding = RecordAt(head);
+            padding->length = 0;
+            padding->level = kPaddingLevel;
+            Commit(padding, start - head);
+        }
+
+        auto header = RecordAt(start);
+        header->length = length;
+        header->level = level;
+        header->subsystem = subsystem;
+        header->tsc = ReadTSC();
+
+        UpdateMaxUsed(end - read_pos.load(std::memory_order_relaxed));
+        return header;
+    }
+
+    /** @brief Reserve で予約したレコードを読み出し可能にする */
+    void Publish(LogRecordHeader* header) {
+        const size_t size = (sizeof(LogRecordHeader) + header->length + 1 + kLogRecordAlign - 1) &
+                            ~(kLogRecordAlign - 1);
+        Commit(header, size);
+        records.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** @brief 書式化した文字列を捨て、長さだけを数えるための出力先 */
+    class NullSink : public FormatSink {
+      public:
+        virtual void Write(const char* s, size_t length) override {}
+    };
+
+    /** @brief 書式化した文字列をシリアルポートへ直接送る出力先 */
+    class SerialSink : public FormatSink {
+      public:
+        virtual void Write(const char* s, size_t length) override {
+            SerialWrite(s, length);
+        }
+    };
+
+    /** @brief シリアルポートへは、各行の先頭にタイムスタンプとサブシステムを付けて出力する */
+    void OutputSerial(uint64_t tsc, uint8_t subsystem, const char* text) {
+        while (*text) {
+            if (serial_line_start) {
+                SerialSink sink;
+                Format(sink,
+                       "[%012lx] %-6s ",
+                       tsc,
+                       subsystem < kNumLogSubsystems ? kLogSubsystemNames[subsystem] : "?");
+            }
+            const char* newline = strchr(text, '\n');
+            const size_t length = newline ? newline - text + 1 : strlen(text);
+            SerialWrite(text, length);
+            serial_line_start = newline != nullptr;
+            text += length;
+        }
+    }
+
+    void Output(const LogRecordHeader& header, const char* text) {
+        console->PutString(text);
+        if (SerialAvailable()) {
+            OutputSerial(header.tsc, header.subsystem, text);
+        }
+    }
 }
 
-extern Console* console;
+LogLevel log_levels[kNumLogSubsystems] = { kWarn, kWarn, kWarn, kWarn, kWarn };
 
 void
 SetLogLevel(LogLevel level) {
-    log_level = level;
+    for (auto& l : log_levels) {
+        l = level;
+    }
+}
+
+void
+SetLogLevel(LogSubsystem subsystem, LogLevel level) {
+    log_levels[subsystem] = level;
+}
+
+int
+WriteLog(LogSubsystem subsystem, LogLevel level, const char* format, va_list ap) {
+    // 1回目で本文の長さを求め、ちょうどの大きさを予約してから、2回目でレコードに直接書き込む
+    NullSink null_sink;
+    const int result = VFormat(null_sink, format, ap);
+
+    size_t length = result;
+    if (length >= kMaxLogMessage) {
+        length = kMaxLogMessage - 1;
+        truncated.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (auto header = Reserve(subsystem, level, length)) {
+        BufferSink body{ reinterpret_cast<char*>(header + 1), length + 1 };
+        VFormat(body, format, ap);
+        Publish(header);
+    }
+
+    // 読み出し側は割り込まれた処理かもしれないので、割り込みハンドラの中では記録だけにする
+    if (!deferred && !InInterrupt()) {
+        DrainLog();
+    }
+    return result;
 }
 
 int
-Log(LogLevel level, const char* format, ...) {
-    if (level > log_level) {
+Log(LogSubsystem subsystem, LogLevel level, const char* format, ...) {
+    if (!IsLogEnabled(subsystem, level)) {
         return 0;
     }
 
     va_list ap;
-    int result;
-    char s[1024];
-
     va_start(ap, format);
-    result = vsprintf(s, format, ap);
+    const int result = WriteLog(subsystem, level, format, ap);
     va_end(ap);
-
-    console->PutString(s);
     return result;
 }
+
+void
+DrainLog() {
+    if (console == nullptr || draining.exchange(true, std::memory_order_acquire)) {
+        return;
+    }
+
+    uint64_t pos = read_pos.load(std::memory_order_relaxed);
+    while (true) {
+        auto header = RecordAt(pos);
+        const uint32_t size = __atomic_load_n(&header->size, __ATOMIC_ACQUIRE);
+        if (size == 0) {
+            // 空か、予約されたレコードの書き込みがまだ終わっていない
+            break;
+        }
+        if (header->level != kPaddingLevel) {
+            Output(*header, reinterpret_cast<const char*>(header + 1));
+        }
+
+        // 未完了のレコードを size == 0 で見分けられるよう、読み終えた領域は 0 に戻す
+        memset(header, 0, size);
+        pos += size;
+        read_pos.store(pos, std::memory_order_release);
+    }
+
+    const uint64_t drops = dropped.load(std::memory_order_relaxed);
+    if (drops != reported_drops) {
+        char s[64];
+        FormatString(s, sizeof(s), "log: %lu records dropped\n", drops - reported_drops);
+        console->PutString(s);
+        SerialWriteString(s);
+        reported_drops = drops;
+    }
+
+    draining.store(false, std::memory_order_release);
+}
+
+void
+EnableDeferredLogging() {
+    deferred = true;
+}
+
+LogStats
+GetLogStats() {
+    return {
+        records.load(std::memory_order_relaxed),
+        dropped.load(std::memory_order_relaxed),
+        truncated.load(std::memory_order_relaxed),
+        max_used.load(std::memory_order_relaxed),
+    };
+}
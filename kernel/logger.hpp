@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+
 enum LogLevel {
     kError = 3,
     kWarn = 4,
@@ -7,8 +11,104 @@ enum LogLevel {
     kDebug = 7,
 };
 
+/**
+ * @brief この値より詳細なレベルの LOG はコンパイル時に取り除く
+ *
+ * make LOG_LEVEL=7 のように指定して変える
+ */
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 6
+#endif
+constexpr LogLevel kCompiledLogLevel = static_cast<LogLevel>(LOG_LEVEL);
+
+/** @brief ログを出したサブシステム サブシステムごとに実行時のログレベルを持つ */
+enum LogSubsystem {
+    kLogKernel,
+    kLogUSB,
+    kLogPCI,
+    kLogGraphics,
+    kLogMemory,
+    kNumLogSubsystems,
+};
+
+/** @brief ログのリングバッファの統計 */
+struct LogStats {
+    /** @brief リングバッファに記録したレコード数 */
+    uint64_t records;
+    /** @brief リングバッファが一杯で捨てたレコード数 */
+    uint64_t dropped;
+    /** @brief 1レコードに収まらず末尾を切り詰めたレコード数 */
+    uint64_t truncated;
+    /** @brief リングバッファの使用量の最大値 (バイト) */
+    size_t max_used;
+};
+
+/** @brief サブシステムごとの実行時のログレベル SetLogLevel で変える */
+extern LogLevel log_levels[kNumLogSubsystems];
+
+/** @brief すべてのサブシステムの実行時のログレベルを設定する */
 void
 SetLogLevel(LogLevel level);
+/** @brief 指定したサブシステムの実行時のログレベルを設定する */
+void
+SetLogLevel(LogSubsystem subsystem, LogLevel level);
+
+/** @brief subsystem の level のログを記録するなら true を返す */
+inline bool
+IsLogEnabled(LogSubsystem subsystem, LogLevel level) {
+    return level <= log_levels[subsystem];
+}
 
+/**
+ * @brief subsystem のログを level で記録する
+ *
+ * level が kCompiledLogLevel より詳細なら呼び出しごと取り除き、引数も評価しない
+ * そうでなければ subsystem の実行時のログレベルを調べてから書式化する
+ * level は定数でなければならない
+ */
+#define LOG(subsystem, level, ...)                                                                 \
+    do {                                                                                           \
+        if constexpr ((level) <= kCompiledLogLevel) {                                              \
+            if (IsLogEnabled((subsystem), (level))) {                                              \
+                Log((subsystem), (level), __VA_ARGS__);                                            \
+            }                                                                                      \
+        }                                                                                          \
+    } while (0)
+
+/**
+ * @brief 書式化した文字列をログのリングバッファに記録する
+ *
+ * 割り込みハンドラを含むどこから呼んでもよく、ロックを取らず待つこともない
+ * リングバッファが一杯ならレコードを捨てる
+ * 記録した内容は DrainLog を呼んだときにコンソールとシリアルポートへ出力する
+ * 通常は LOG マクロを通して呼ぶ
+ */
+int
+Log(LogSubsystem subsystem, LogLevel level, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+/** @brief ログレベルによる選別をせずに、書式化した文字列をリングバッファに記録する */
 int
-Log(LogLevel level, const char* format, ...);
+WriteLog(LogSubsystem subsystem, LogLevel level, const char* format, va_list ap)
+    __attribute__((format(printf, 3, 0)));
+
+/**
+ * @brief リングバッファに溜まったログをコンソールとシリアルポートへ出力する
+ *
+ * シリアルポートへは各行にタイムスタンプとサブシステム名を付ける
+ *
+ * 読み出し側は1つだけなので、割り込みハンドラからは呼ばないこと
+ * 別の DrainLog の実行中に呼ばれた場合は何もしない
+ */
+void
+DrainLog();
+/**
+ * @brief これ以降の Log を記録だけにして、出力をメインループの DrainLog に任せる
+ *
+ * 呼ぶまでは Log のたびに DrainLog を呼んで、起動中のログをすぐに表示する
+ * ただし割り込みハンドラの中の Log は、呼ぶ前でも記録だけにする
+ */
+void
+EnableDeferredLogging();
+/** @brief ログのリングバッファの統計を返す */
+LogStats
+GetLogStats();
@@ -1,18 +1,27 @@
 #include "asmfunc.h"
 #include "console.hpp"
 #include "font.hpp"
+#include "format.hpp"
 #include "frame_buffer_config.hpp"
+#include "frame_scheduler.hpp"
 #include "graphics.hpp"
+#include "idle.hpp"
 #include "interrupt.hpp"
+#include "ioapic.hpp"
 #include "layer.hpp"
 #include "logger.hpp"
 #include "memory_manager.hpp"
 #include "memory_map.hpp"
+#include "message.hpp"
 #include "mouse.hpp"
 #include "paging.hpp"
 #include "pci.hpp"
-#include "queue.hpp"
 #include "segment.hpp"
+#include "serial.hpp"
+#include "simd.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+#include "usb/classdriver/keyboard.hpp"
 #include "usb/classdriver/mouse.hpp"
 #include "usb/device.hpp"
 #include "usb/memory.hpp"
@@ -21,7 +30,7 @@
 #include "window.hpp"
 #include <cstddef>
 #include <cstdint>
-#include <cstdio>
+#include <cstdarg>
 #include <numeric>
 #include <vector>
 
@@ -32,57 +41,76 @@ PixelWriter* pixel_writer;
 char console_buf[sizeof(Console)];
 Console* console;
 
-int
+__attribute__((format(printf, 1, 2))) int
 printk(const char* format, ...) {
     va_list ap;
     int result;
-    char s[1024];
 
     va_start(ap, format);
-    result = vsprintf(s, format, ap);
+    result = WriteLog(kLogKernel, kInfo, format, ap);
     va_end(ap);
-
-    console->PutString(s);
     return result;
 }
 
 char memory_manager_buf[sizeof(BitmapMemoryManager)];
 BitmapMemoryManager* memory_manager;
 
-unsigned int mouse_layer_id;
 Vector2D<int> screen_size;
 Vector2D<int> mouse_position;
 
+/** @brief 割り込みハンドラなどからメインループへメッセージを渡すキュー */
+MessageQueue* main_queue;
+
+MouseInputState mouse_input;
+
+/** @brief 前回の呼び出しから溜まったマウスの入力を、区間ごとに順に反映する */
 void
-MouseObserver(uint8_t buttons, int8_t displacement_x, int8_t displacement_y) {
+ApplyMouseInput() {
     static unsigned int mouse_drag_layer_id = 0;
     static uint8_t previous_buttons = 0;
 
-    const auto oldpos = mouse_position;
-    auto newpos = mouse_position + Vector2D<int>{ displacement_x, displacement_y };
-    newpos = ElementMin(newpos, screen_size + Vector2D<int>{ -1, -1 });
-    mouse_position = ElementMax(newpos, { 0, 0 });
+    mouse_input.Drain([](const MouseInputState::Segment& segment) {
+        const auto oldpos = mouse_position;
+        auto newpos = mouse_position + segment.displacement;
+        newpos = ElementMin(newpos, screen_size + Vector2D<int>{ -1, -1 });
+        mouse_position = ElementMax(newpos, { 0, 0 });
 
-    const auto posdiff = mouse_position - oldpos;
+        const auto posdiff = mouse_position - oldpos;
 
-    layer_manager->Move(mouse_layer_id, mouse_position);
+        layer_manager->MoveCursor(mouse_position);
 
-    const bool previous_left_pressed = (previous_buttons & 0x01);
-    const bool left_pressed = (buttons & 0x01);
-    if (!previous_left_pressed && left_pressed) {
-        auto layer = layer_manager->FindLayerByPosition(mouse_position, mouse_layer_id);
-        if (layer && layer->IsDraggable()) {
-            mouse_drag_layer_id = layer->ID();
-        }
-    } else if (previous_left_pressed && left_pressed) {
-        if (mouse_drag_layer_id > 0) {
-            layer_manager->MoveRelative(mouse_drag_layer_id, posdiff);
+        const bool previous_left_pressed = (previous_buttons & 0x01);
+        const bool left_pressed = (segment.buttons & 0x01);
+        if (!previous_left_pressed && left_pressed) {
+            auto layer = layer_manager->FindLayerByPosition(mouse_position, 0);
+            if (layer && layer->IsDraggable()) {
+                mouse_drag_layer_id = layer->ID();
+            }
+        } else if (previous_left_pressed && left_pressed) {
+            if (mouse_drag_layer_id > 0) {
+                layer_manager->MoveRelative(mouse_drag_layer_id, posdiff);
+            }
+        } else if (previous_left_pressed && !left_pressed) {
+            mouse_drag_layer_id = 0;
         }
-    } else if (previous_left_pressed && !left_pressed) {
-        mouse_drag_layer_id = 0;
-    }
 
-    previous_buttons = buttons;
+        previous_buttons = segment.buttons;
+    });
+}
+
+void
+MouseObserver(uint8_t buttons, int8_t displacement_x, int8_t displacement_y) {
+    Trace(kTraceMouseEvent,
+          buttons,
+          static_cast<uint16_t>(displacement_x) |
+              static_cast<uint32_t>(static_cast<uint16_t>(displacement_y)) << 16);
+    // 移動やドラッグは、入力の優先度で処理する kMouseInput の ApplyMouseInput でまとめて行う
+    if (mouse_input.Add(buttons, displacement_x, displacement_y)) {
+        // 区間が一杯なら、クリックを失わないようメッセージを待たずに反映して空ける
+        ApplyMouseInput();
+        mouse_input.Add(buttons, displacement_x, displacement_y);
+    }
+    main_queue->Post(Message{ Message::kMouseInput });
 }
 
 void
@@ -103,22 +131,186 @@ SwitchEhci2Xhci(const pci::Device& xhc_dev) {
     pci::WriteConfReg(xhc_dev, 0xd8, superspeed_ports);          // USB3_PSSEN
     uint32_t ehci2xhci_ports = pci::ReadConfReg(xhc_dev, 0xd4);  // XUSB2PRM
     pci::WriteConfReg(xhc_dev, 0xd0, ehci2xhci_ports);           // XUSB2PR
-    Log(kDebug, "SwitchEhci2Xhci: SS = %02, xHCI = %02x\n", superspeed_ports, ehci2xhci_ports);
+    LOG(kLogPCI,
+        kDebug,
+        "SwitchEhci2Xhci: SS = %02x, xHCI = %02x\n",
+        superspeed_ports,
+        ehci2xhci_ports);
+}
+
+/** @brief SetCacheType を呼び、失敗したらメモリタイプを変えられなかった範囲を警告する */
+void
+SetCacheTypeOrWarn(uintptr_t base, size_t size, CacheType type) {
+    if (auto err = SetCacheType(base, size, type)) {
+        LOG(kLogMemory,
+            kWarn,
+            "failed to set cache type %d for %08lx+%zx: %s at %s:%d\n",
+            static_cast<int>(type),
+            base,
+            size,
+            err.Name(),
+            err.File(),
+            err.Line());
+    }
 }
 
 usb::xhci::Controller* xhc;
 
-struct Message {
-    enum Type {
-        kInterruptXHCI,
-    } type;
-};
+/** @brief 1つの kInterruptXHCI で処理するイベントの最大数 残りは改めて積んだメッセージで処理する */
+const int kXHCIEventBudget = 64;
+
+void
+KeyboardObserver(uint8_t keycode) {
+    Message msg{ Message::kKeyPush };
+    msg.arg.key.keycode = keycode;
+    main_queue->Post(msg);
+}
+
+/** @brief NewWindow でウィンドウを作る 作れなければ起動を続けられないので停止する */
+std::shared_ptr<Window>
+NewWindowOrExit(int width, int height, PixelFormat format) {
+    auto [window, err] = NewWindow(width, height, format);
+    if (err) {
+        LOG(kLogGraphics,
+            kError,
+            "failed to create window: %s at %s:%d\n",
+            err.Name(),
+            err.File(),
+            err.Line());
+        DrainLog();
+        console->Flush();
+        SerialFlush();
+        exit(1);
+    }
+    return window;
+}
+
+/** @brief WriteStats で統計をデバッグログへ出す間隔 (秒) */
+const unsigned int kStatsLogSeconds = 10;
+
+/**
+ * @brief 各モジュールの統計を1行ずつ書式化して write に渡す
+ *
+ * 一定間隔でデバッグログへ出すほか、F11 でシリアルポートへ書き出す
+ */
+void
+WriteStats(void (*write)(const char* line)) {
+    char line[128];
+
+    const auto frame = GetFrameStats();
+    FormatString(line,
+                 sizeof(line),
+                 "frames %lu: avg %lu us, max %lu us, missed %lu, skipped %lu\n",
+                 frame.frames,
+                 TSCToMicros(frame.frames ? frame.total_frame_time / frame.frames : 0),
+                 TSCToMicros(frame.max_frame_time),
+                 frame.missed_deadlines,
+                 frame.skipped);
+    write(line);
+
+    const auto idle = GetIdleStats();
+    FormatString(line,
+                 sizeof(line),
+                 "idle: residency %lu%%, wakeups %lu, handler-to-loop avg %lu max %lu (TSC)\n",
+                 idle.total_time ? idle.idle_time * 100 / idle.total_time : 0,
+                 idle.wakeups,
+                 idle.wakeups ? idle.total_resume_time / idle.wakeups : 0,
+                 idle.max_resume_time);
+    write(line);
+
+    // 1区間あたりのレポート数が、フレームごとにまとめて減らせたマウスの処理の割合を表す
+    const uint64_t reports = mouse_input.Reports(), segments = mouse_input.Segments();
+    const uint64_t reports_per_segment = segments ? reports * 100 / segments : 0;
+    FormatString(line,
+                 sizeof(line),
+                 "mouse: reports %lu, segments %lu, %lu.%02lu reports per segment\n",
+                 reports,
+                 segments,
+                 reports_per_segment / 100,
+                 reports_per_segment % 100);
+    write(line);
+
+    const auto queue = main_queue->Stats();
+    FormatString(line,
+                 sizeof(line),
+                 "queue: posted %lu, collapsed %lu, dropped %lu, dispatched %lu\n",
+                 queue.posted,
+                 queue.collapsed,
+                 queue.dropped,
+                 queue.dispatched);
+    write(line);
+
+    const auto log = GetLogStats();
+    FormatString(line,
+                 sizeof(line),
+                 "log: records %lu, dropped %lu, truncated %lu, max used %zu bytes\n",
+                 log.records,
+                 log.dropped,
+                 log.truncated,
+                 log.max_used);
+    write(line);
+}
 
-ArrayQueue<Message>* main_queue;
+/** @brief 特別な操作を割り当てたキーの HID キーコード */
+const uint8_t kKeyPageUp = 0x4b;
+const uint8_t kKeyPageDown = 0x4e;
+const uint8_t kKeyF11 = 0x44;
+const uint8_t kKeyF12 = 0x45;
 
+/** @brief メインループで受け取ったキー入力を処理する */
+void
+HandleKeyPush(uint8_t keycode) {
+    switch (keycode) {
+        case kKeyPageUp:
+            console->ScrollView(Console::kRows / 2);
+            break;
+        case kKeyPageDown:
+            console->ScrollView(-Console::kRows / 2);
+            break;
+        case kKeyF11:
+            WriteStats(SerialWriteString);
+            break;
+        case kKeyF12:
+            // tools/trace2json.py で変換できる形式で、記録済みのトレースをシリアルポートへ送る
+            DumpTrace(SerialWriteString);
+            break;
+    }
+}
+
+// 割り込みハンドラから呼ぶ関数には no_caller_saved_registers を付け、全レジスタの退避を避ける
 __attribute__((interrupt)) void
 IntHandlerXHCI(InterruptFrame* frame) {
-    main_queue->Push(Message{ Message::kInterruptXHCI });
+    InterruptScope interrupt_scope;
+    InterruptSIMDGuard simd_guard;
+    NotifyIdleWakeup();
+    Trace(kTraceXHCIInterrupt, InterruptVector::kXHCI);
+    main_queue->Post(Message{ Message::kInterruptXHCI });
+    NotifyEndOfInterrupt();
+}
+
+__attribute__((interrupt)) void
+IntHandlerLAPICTimer(InterruptFrame* frame) {
+    InterruptScope interrupt_scope;
+    InterruptSIMDGuard simd_guard;
+    NotifyIdleWakeup();
+    Trace(kTraceFrameTick, InterruptVector::kLAPICTimer);
+    if (OnFrameTick()) {
+        Message msg{ Message::kFrameTick };
+        msg.arg.frame.tsc = ReadTSC();
+        if (auto err = main_queue->Post(msg)) {
+            CancelFrameTick();
+        }
+    }
+    NotifyEndOfInterrupt();
+}
+
+__attribute__((interrupt)) void
+IntHandlerSerial(InterruptFrame* frame) {
+    InterruptScope interrupt_scope;
+    InterruptSIMDGuard simd_guard;
+    NotifyIdleWakeup();
+    Trace(kTraceSerialInterrupt, InterruptVector::kSerial);
+    SerialOnInterrupt();
     NotifyEndOfInterrupt();
 }
 
@@ -130,6 +322,15 @@ KernelMainNewStack(const FrameBufferConfig& frame_buffer_config_ref,
                    const MemoryMap& memory_map_ref) {
     FrameBufferConfig frame_buffer_config{ frame_buffer_config_ref };
     MemoryMap memory_map{ memory_map_ref };
+    InitializeSIMD();
+    LOG(kLogKernel,
+        kInfo,
+        "SIMD: level %d, state %zu bytes\n",
+        static_cast<int>(CurrentSIMDLevel()),
+        SIMDStateSize());
+    InitializeTrace(0);
+    EnableTrace(kTraceAllCategories);
+
     // ピクセルフォーマットに応じて、RGBまたはBGRのPixelWriterを作成
     switch (frame_buffer_config.pixel_format) {
         case kPixelRGBResv8BitPerColor:
@@ -157,6 +358,19 @@ KernelMainNewStack(const FrameBufferConfig& frame_buffer_config_ref,
     SetCSSS(kernel_cs, kernel_ss);
 
     SetupIdentityPageTable();
+    InitializePAT();
+    // 画面への書き込みはまとめて転送できるよう WC、Local APIC のレジスタは UC とする
+    SetCacheTypeOrWarn(reinterpret_cast<uintptr_t>(frame_buffer_config.frame_buffer),
+                       4 * frame_buffer_config.pixels_per_scan_line *
+                           frame_buffer_config.vertical_resolution,
+                       CacheType::kWriteCombining);
+    SetCacheTypeOrWarn(0xfee00000, 4_KiB, CacheType::kUncached);
+    SetCacheTypeOrWarn(kIOAPICBase, 4_KiB, CacheType::kUncached);
+
+    InitializeIOAPIC();
+    if (!InitializeSerial()) {
+        LOG(kLogKernel, kWarn, "COM1 is not available\n");
+    }
 
     ::memory_manager = new (memory_manager_buf) BitmapMemoryManager;
 
@@ -181,28 +395,38 @@ KernelMainNewStack(const FrameBufferConfig& frame_buffer_config_ref,
     memory_manager->SetMemoryRange(FrameID{ 1 }, FrameID{ available_end / kBytesPerFrame });
 
     if (auto err = InitializeHeap(*memory_manager)) {
-        Log(kError, "failed to allocate pages: %s at %s:%d\n", err.Name(), err.File(), err.Line());
+        LOG(kLogMemory,
+            kError,
+            "failed to allocate pages: %s at %s:%d\n",
+            err.Name(),
+            err.File(),
+            err.Line());
+        DrainLog();
+        console->Flush();
+        SerialFlush();
         exit(1);
     }
 
-    std::array<Message, 32> main_queue_data;
-    ArrayQueue<Message> main_queue{ main_queue_data };
+    MessageQueue main_queue;
     ::main_queue = &main_queue;
 
     auto err = pci::ScanAllBus();
-    Log(kDebug, "ScanAllBus: %s\n", err.Name());
+    LOG(kLogPCI, kDebug, "ScanAllBus: %s\n", err.Name());
 
     for (int i = 0; i < pci::num_device; ++i) {
         const auto& dev = pci::devices[i];
         auto vendor_id = pci::ReadVendorId(dev);
         auto class_code = pci::ReadClassCode(dev.bus, dev.device, dev.function);
-        Log(kDebug,
-            "%d.%d.%d: vend %04x, class %08x, head %02x\n",
+        LOG(kLogPCI,
+            kDebug,
+            "%d.%d.%d: vend %04x, class %02x%02x%02x, head %02x\n",
             dev.bus,
             dev.device,
             dev.function,
             vendor_id,
-            class_code,
+            class_code.base,
+            class_code.sub,
+            class_code.interface,
             dev.header_type);
     }
 
@@ -219,7 +443,8 @@ KernelMainNewStack(const FrameBufferConfig& frame_buffer_config_ref,
     }
 
     if (xhc_dev) {
-        Log(kInfo,
+        LOG(kLogPCI,
+            kInfo,
             "xHC has been found: %d.%d.%d\n",
             xhc_dev->bus,
             xhc_dev->device,
@@ -230,9 +455,20 @@ KernelMainNewStack(const FrameBufferConfig& frame_buffer_config_ref,
                 MakeIDTAttr(DescriptorType::kInterruptGate, 0),
                 reinterpret_cast<uint64_t>(IntHandlerXHCI),
                 kernel_cs);
+    SetIDTEntry(idt[InterruptVector::kSerial],
+                MakeIDTAttr(DescriptorType::kInterruptGate, 0),
+                reinterpret_cast<uint64_t>(IntHandlerSerial),
+                kernel_cs);
+    SetIDTEntry(idt[InterruptVector::kLAPICTimer],
+                MakeIDTAttr(DescriptorType::kInterruptGate, 0),
+                reinterpret_cast<uint64_t>(IntHandlerLAPICTimer),
+                kernel_cs);
     LoadIDT(sizeof(idt) - 1, reinterpret_cast<uintptr_t>(&idt[0]));
 
     const uint8_t bsp_local_apic_id = *reinterpret_cast<const uint32_t*>(0xfee00020) >> 24;
+    if (SerialAvailable()) {
+        RouteISAInterrupt(4 /* COM1 */, InterruptVector::kSerial, bsp_local_apic_id);
+    }
     pci::ConfigureMSIFixedDestination(*xhc_dev,
                                       bsp_local_apic_id,
                                       pci::MSITriggerMode::kLevel,
@@ -241,9 +477,10 @@ KernelMainNewStack(const FrameBufferConfig& frame_buffer_config_ref,
                                       0);
 
     const WithError<uint64_t> xhc_bar = pci::ReadBar(*xhc_dev, 0);
-    Log(kDebug, "ReadBar: %s\n", xhc_bar.error.Name());
+    LOG(kLogPCI, kDebug, "ReadBar: %s\n", xhc_bar.error.Name());
     const uint64_t xhc_mmio_base = xhc_bar.value & ~static_cast<uint64_t>(0xf);
-    Log(kDebug, "xHC mmio_base = %08lx\n", xhc_mmio_base);
+    LOG(kLogPCI, kDebug, "xHC mmio_base = %08lx\n", xhc_mmio_base);
+    SetCacheTypeOrWarn(xhc_mmio_base, 64_KiB, CacheType::kUncached);
 
     usb::xhci::Controller xhc{ xhc_mmio_base };
 
@@ -252,23 +489,25 @@ KernelMainNewStack(const FrameBufferConfig& frame_buffer_config_ref,
     }
     {
         auto err = xhc.Initialize();
-        Log(kDebug, "xhc.Initialize: %s\n", err.Name());
+        LOG(kLogUSB, kDebug, "xhc.Initialize: %s\n", err.Name());
     }
 
-    Log(kInfo, "xHC starting\n");
+    LOG(kLogUSB, kInfo, "xHC starting\n");
     xhc.Run();
 
     ::xhc = &xhc;
 
     usb::HIDMouseDriver::default_observer = MouseObserver;
+    usb::HIDKeyboardDriver::default_observer = KeyboardObserver;
 
     for (int i = 1; i <= xhc.MaxPorts(); ++i) {
         auto port = xhc.PortAt(i);
-        Log(kDebug, "Port %d: IsConnected=%d\n", i, port.IsConnected());
+        LOG(kLogUSB, kDebug, "Port %d: IsConnected=%d\n", i, port.IsConnected());
 
         if (port.IsConnected()) {
             if (auto err = ConfigurePort(xhc, port)) {
-                Log(kError,
+                LOG(kLogUSB,
+                    kError,
                     "failed to configure port: %s at %s:%d\n",
                     err.Name(),
                     err.File(),
@@ -282,27 +521,28 @@ KernelMainNewStack(const FrameBufferConfig& frame_buffer_config_ref,
     screen_size.y = frame_buffer_config.vertical_resolution;
 
     auto bgwindow =
-        std::make_shared<Window>(screen_size.x, screen_size.y, frame_buffer_config.pixel_format);
+        NewWindowOrExit(screen_size.x, screen_size.y, frame_buffer_config.pixel_format);
     auto bgwriter = bgwindow->Writer();
 
     DrawDesktop(*bgwriter);
 
-    auto mouse_window = std::make_shared<Window>(
+    auto mouse_window = NewWindowOrExit(
         kMouseCursorWidth, kMouseCursorHeight, frame_buffer_config.pixel_format);
     mouse_window->SetTransparentColor(kMouseTransparentColor);
     DrawMouseCursor(mouse_window->Writer(), { 0, 0 });
     mouse_position = { 200, 200 };
 
-    auto main_window = std::make_shared<Window>(160, 52, frame_buffer_config.pixel_format);
+    auto main_window = NewWindowOrExit(160, 52, frame_buffer_config.pixel_format);
     DrawWindow(*main_window->Writer(), "Hello Window");
 
-    auto console_window = std::make_shared<Window>(
+    auto console_window = NewWindowOrExit(
         Console::kColumns * 8, Console::kRows * 16, frame_buffer_config.pixel_format);
     console->SetWindow(console_window);
 
     FrameBuffer screen;
     if (auto err = screen.Initialize(frame_buffer_config)) {
-        Log(kError,
+        LOG(kLogGraphics,
+            kError,
             "failed to initialize frame buffer: %s at %s:%d\n",
             err.Name(),
             err.File(),
@@ -310,10 +550,20 @@ KernelMainNewStack(const FrameBufferConfig& frame_buffer_config_ref,
     }
 
     layer_manager = new LayerManager;
-    layer_manager->SetWriter(&screen);
+    if (auto err = layer_manager->SetWriter(&screen)) {
+        LOG(kLogGraphics,
+            kError,
+            "failed to set layer writer: %s at %s:%d\n",
+            err.Name(),
+            err.File(),
+            err.Line());
+        DrainLog();
+        console->Flush();
+        SerialFlush();
+        exit(1);
+    }
 
     auto bglayer_id = layer_manager->NewLayer().SetWindow(bgwindow).Move({ 0, 0 }).ID();
-    mouse_layer_id = layer_manager->NewLayer().SetWindow(mouse_window).Move(mouse_position).ID();
     auto main_window_layer_id =
         layer_manager->NewLayer().SetWindow(main_window).SetDraggable(true).Move({ 300, 100 }).ID();
     console->SetLayerID(layer_manager->NewLayer().SetWindow(console_window).Move({ 0, 0 }).ID());
@@ -321,49 +571,101 @@ KernelMainNewStack(const FrameBufferConfig& frame_buffer_config_ref,
     layer_manager->UpDown(bglayer_id, 0);
     layer_manager->UpDown(console->LayerID(), 1);
     layer_manager->UpDown(main_window_layer_id, 2);
-    layer_manager->UpDown(mouse_layer_id, 3);
+    if (auto err = layer_manager->SetCursor(mouse_window, mouse_position)) {
+        LOG(kLogGraphics,
+            kError,
+            "failed to set mouse cursor: %s at %s:%d\n",
+            err.Name(),
+            err.File(),
+            err.Line());
+    }
     layer_manager->Draw({ { 0, 0 }, screen_size });
 
     char str[128];
     unsigned int count = 0;
 
-    while (true) {
-        ++count;
-        sprintf(str, "%010u", count);
-        FillRectangle(*main_window->Writer(), { 24, 28 }, { 8 * 10, 16 }, { 0xc6, 0xc6, 0xc6 });
-        WriteString(*main_window->Writer(), { 24, 28 }, str, { 0, 0, 0 });
-        layer_manager->Draw(main_window_layer_id);
+    // ここからは割り込みハンドラが動くので、ログの出力はメインループでまとめて行う
+    EnableDeferredLogging();
 
-        __asm__("cli");
-        if (main_queue.Count() == 0) {
-            __asm__("sti");
-            continue;
-        }
-
-        Message msg = main_queue.Front();
-        main_queue.Pop();
-        __asm__("sti");
+    // 画面への反映はフレームの周期ごとに1回だけ行う
+    InitializeFrameScheduler(kDefaultFrameRate, InterruptVector::kLAPICTimer);
+    InitializeIdle(IDLE_MWAIT ? IdleMode::kMWait : IdleMode::kHlt);
+    LOG(kLogKernel,
+        kInfo,
+        "idle: %s\n",
+        CurrentIdleMode() == IdleMode::kMWait ? "monitor/mwait" : "hlt");
 
+    auto handle_message = [&](const Message& msg) {
         switch (msg.type) {
+            case Message::kKeyPush:
+                LOG(kLogUSB, kDebug, "key push: %02x\n", msg.arg.key.keycode);
+                HandleKeyPush(msg.arg.key.keycode);
+                break;
+            case Message::kMouseInput:
+                // カーソルとドラッグ中のレイヤーの位置だけを更新し、画面への反映はフレームに任せる
+                ApplyMouseInput();
+                break;
+            case Message::kFrameTick:
+                BeginFrame(msg.arg.frame.tsc);
+                ++count;
+                FormatString(str, sizeof(str), "%010u", count);
+                WriteString(
+                    *main_window->Writer(), { 24, 28 }, str, { 0, 0, 0 }, { 0xc6, 0xc6, 0xc6 });
+                // コンソールへのログ出力も含め、前回からの書き換えをまとめて画面へ反映する
+                DrainLog();
+                // kMouseInput を積めなかったときのために、描画の前に残りの入力を反映する
+                ApplyMouseInput();
+                layer_manager->Flush();
+                EndFrame();
+                if (IsLogEnabled(kLogKernel, kDebug) &&
+                    GetFrameStats().frames % (FrameRate() * kStatsLogSeconds) == 0) {
+                    WriteStats([](const char* line) { LOG(kLogKernel, kDebug, "%s", line); });
+                }
+                break;
             case Message::kInterruptXHCI:
-                while (xhc.PrimaryEventRing()->HasFront()) {
+                // イベントが途切れなくても他の優先度を待たせないよう、一度に処理する数を区切る
+                for (int i = 0; i < kXHCIEventBudget && xhc.PrimaryEventRing()->HasFront(); ++i) {
                     if (auto err = ProcessEvent(xhc)) {
-                        Log(kError,
+                        LOG(kLogUSB,
+                            kError,
                             "Error while ProcessEvent: %s at %s:%d\n",
                             err.Name(),
                             err.File(),
                             err.Line());
                     }
                 }
+                if (xhc.PrimaryEventRing()->HasFront()) {
+                    main_queue.Post(Message{ Message::kInterruptXHCI });
+                }
                 break;
             default:
-                Log(kError, "Unknown message type: %d\n", msg.type);
+                LOG(kLogKernel, kError, "Unknown message type: %d\n", msg.type);
+        }
+    };
+
+    while (true) {
+        // 割り込みを禁止せずに、優先度の高いものから溜まっているメッセージをまとめて処理する
+        if (main_queue.Dispatch(handle_message) > 0) {
+            continue;
+        }
+
+        __asm__("cli");
+        if (main_queue.Empty()) {
+            // 割り込みを禁止したまま確かめたので、停止までの間に来た割り込みも取りこぼさない
+            Idle();
+        } else {
+            __asm__("sti");
         }
     }
 }
 
 extern "C" void
 __cxa_pure_virtual() {
+    LOG(kLogKernel, kError, "pure virtual function called\n");
+    DrainLog();
+    console->Flush();
+    DumpTrace(SerialWriteString);
+    SerialFlush();
     while (1)
         __asm__("hlt");
 }
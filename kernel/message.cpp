@@ -0,0 +1,52 @@
+/**
+ * @file message.cpp
+ *
+ * メッセージキューのプログラムを集めたファイル
+ */
+
+#include "message.hpp"
+
+MessageQueue::MessageQueue() {
+    for (auto& pending : pending_) {
+        pending.store(false, std::memory_order_relaxed);
+    }
+}
+
+Error __attribute__((no_caller_saved_registers))
+MessageQueue::Post(const Message& msg) {
+    posted_.fetch_add(1, std::memory_order_relaxed);
+    const bool collapsible = IsCollapsible(msg.type);
+    if (collapsible && pending_[msg.type].exchange(true, std::memory_order_acq_rel)) {
+        collapsed_.fetch_add(1, std::memory_order_relaxed);
+        return MAKE_ERROR(Error::kSuccess);
+    }
+
+    if (auto err = queues_[PriorityOf(msg.type)].Push(msg)) {
+        if (collapsible) {
+            pending_[msg.type].store(false, std::memory_order_release);
+        }
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return err;
+    }
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+bool
+MessageQueue::Empty() const {
+    for (const auto& queue : queues_) {
+        if (queue.Count() != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+MessageStats
+MessageQueue::Stats() const {
+    return {
+        posted_.load(std::memory_order_relaxed),
+        collapsed_.load(std::memory_order_relaxed),
+        dropped_.load(std::memory_order_relaxed),
+        dispatched_,
+    };
+}
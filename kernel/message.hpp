@@ -0,0 +1,144 @@
+/**
+ * @file message.hpp
+ *
+ * 割り込みハンドラなどからメインループへ渡すメッセージと、その優先度付きのキューを提供する
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "error.hpp"
+#include "queue.hpp"
+
+/** @brief メッセージの優先度 値の小さいものから先に処理する */
+enum MessagePriority {
+    kPriorityInput,
+    kPriorityTimer,
+    kPriorityDevice,
+    kPriorityBackground,
+    kNumMessagePriorities,
+};
+
+struct Message {
+    enum Type {
+        kInterruptXHCI,
+        kFrameTick,
+        kKeyPush,
+        /** @brief MouseInputState にマウスの入力が溜まった */
+        kMouseInput,
+        kNumTypes,
+    } type;
+
+    union {
+        struct {
+            /** @brief タイマ割り込みが来たときの TSC */
+            uint64_t tsc;
+        } frame;
+        struct {
+            uint8_t keycode;
+        } key;
+    } arg;
+};
+
+constexpr MessagePriority
+PriorityOf(Message::Type type) {
+    switch (type) {
+        case Message::kKeyPush:
+        case Message::kMouseInput:
+            return kPriorityInput;
+        case Message::kFrameTick:
+            return kPriorityTimer;
+        case Message::kInterruptXHCI:
+            return kPriorityDevice;
+        default:
+            return kPriorityBackground;
+    }
+}
+
+/**
+ * @brief 処理待ちのものがあれば、新たに積まずにまとめてよい種類なら true を返す
+ *
+ * 「xHC のイベントリングに処理すべきイベントがある」のように、1回の処理で
+ * それまでの知らせをすべて片付けられる種類が該当する
+ */
+constexpr bool
+IsCollapsible(Message::Type type) {
+    return type == Message::kInterruptXHCI || type == Message::kMouseInput;
+}
+
+/** @brief MessageQueue の統計 */
+struct MessageStats {
+    uint64_t posted;
+    /** @brief 処理待ちのものにまとめたため、積まなかった数 */
+    uint64_t collapsed;
+    /** @brief キューが一杯で捨てた数 */
+    uint64_t dropped;
+    uint64_t dispatched;
+};
+
+/**
+ * @brief 優先度ごとのロックフリーなキューを持ち、優先度順にまとめてメッセージを処理する
+ *
+ * Post は割り込みハンドラからも呼べる Dispatch はメインループだけが呼ぶ
+ */
+class MessageQueue {
+  public:
+    /** @brief 優先度ごとのキューの容量 */
+    static const size_t kCapacity = 32;
+    /** @brief 1回の Dispatch で各優先度から取り出す最大数 */
+    static constexpr std::array<size_t, kNumMessagePriorities> kBudgets = { 16, 4, 8, 2 };
+
+    MessageQueue();
+
+    /**
+     * @brief メッセージを優先度に応じたキューへ積む
+     *
+     * IsCollapsible な種類で、同じ種類がすでに処理待ちなら何もせずに成功を返す
+     */
+    Error __attribute__((no_caller_saved_registers)) Post(const Message& msg);
+
+    /**
+     * @brief 優先度の高いキューから順に、kBudgets の数までまとめて取り出して handler に渡す
+     *
+     * 大量のメッセージが届き続ける優先度があっても、他の優先度も毎回処理される
+     *
+     * @return 処理したメッセージの数
+     */
+    template<class F>
+    size_t Dispatch(F&& handler);
+
+    /** @brief 処理待ちのメッセージが無ければ true を返す */
+    bool Empty() const;
+    MessageStats Stats() const;
+
+  private:
+    std::array<MPSCQueue<Message, kCapacity>, kNumMessagePriorities> queues_;
+    /** @brief IsCollapsible な種類のメッセージがキューにあれば true */
+    std::array<std::atomic<bool>, Message::kNumTypes> pending_;
+    std::atomic<uint64_t> posted_{ 0 }, collapsed_{ 0 }, dropped_{ 0 };
+    uint64_t dispatched_{ 0 };
+};
+
+template<class F>
+size_t
+MessageQueue::Dispatch(F&& handler) {
+    size_t total = 0;
+    for (int priority = 0; priority < kNumMessagePriorities; ++priority) {
+        Message messages[kCapacity];
+        const size_t count = queues_[priority].Pop(messages, kBudgets[priority]);
+        for (size_t i = 0; i < count; ++i) {
+            const auto type = messages[i].type;
+            if (IsCollapsible(type)) {
+                // 処理を始める前に下ろすので、処理中に来た知らせは改めて積まれる
+                pending_[type].store(false, std::memory_order_release);
+            }
+            handler(messages[i]);
+        }
+        total += count;
+    }
+    dispatched_ += total;
+    return total;
+}
@@ -27,3 +27,34 @@ DrawMouseCursor(PixelWriter* pixel_writer, Vector2D<int> position) {
         }
     }
 }
+
+Error
+MouseInputState::Add(uint8_t buttons, int8_t displacement_x, int8_t displacement_y) {
+    const Vector2D<int> displacement{ displacement_x, displacement_y };
+    const bool buttons_changed = buttons != last_buttons_;
+
+    // ボタンの状態を変えたレポートは単独の区間とし、押下した位置を後続の移動と混ぜない
+    if (num_segments_ > 0 && !buttons_changed && !last_is_edge_) {
+        segments_[num_segments_ - 1].displacement += displacement;
+    } else if (num_segments_ < kMaxSegments) {
+        segments_[num_segments_++] = { buttons, displacement };
+        ++segments_total_;
+    } else {
+        return MAKE_ERROR(Error::kFull);
+    }
+
+    ++reports_;
+    last_buttons_ = buttons;
+    last_is_edge_ = buttons_changed;
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+uint64_t
+MouseInputState::Reports() const {
+    return reports_;
+}
+
+uint64_t
+MouseInputState::Segments() const {
+    return segments_total_;
+}
@@ -6,6 +6,10 @@
 
 #pragma once
 
+#include <array>
+#include <cstdint>
+
+#include "error.hpp"
 #include "graphics.hpp"
 
 const int kMouseCursorWidth = 15;
@@ -13,4 +17,53 @@ const int kMouseCursorHeight = 24;
 const PixelColor kMouseTransparentColor{ 0, 0, 1 };
 
 void
-DrawMouseCursor(PixelWriter* pixel_writer, Vector2D<int> position);
\ No newline at end of file
+DrawMouseCursor(PixelWriter* pixel_writer, Vector2D<int> position);
+
+/**
+ * @brief 1フレームの間に届いたマウスの入力をまとめる
+ *
+ * ボタンの状態が変わらない間の移動量は1つの区間に合算する ボタンの状態を変えたレポートは
+ * それだけで1つの区間とするので、押下・解放した位置と移動の順序は保たれる
+ * 区間が一杯でも他の区間に合算することはせず、Add が失敗するので先に Drain させる
+ */
+class MouseInputState {
+  public:
+    /** @brief 1フレームに保持する区間の最大数 */
+    static const int kMaxSegments = 16;
+
+    /** @brief ボタンの状態が一定だった間の移動量 */
+    struct Segment {
+        uint8_t buttons;
+        Vector2D<int> displacement;
+    };
+
+    /**
+     * @brief HID マウスのレポートを1つ加える
+     *
+     * @return 新しい区間が必要なのに空きが無ければ kFull レポートは加えないので、
+     *         Drain してから加え直す
+     */
+    Error Add(uint8_t buttons, int8_t displacement_x, int8_t displacement_y);
+    /** @brief 溜まった区間を古い順に func に渡し、空にする */
+    template<class F>
+    void Drain(F func) {
+        for (int i = 0; i < num_segments_; ++i) {
+            func(segments_[i]);
+        }
+        num_segments_ = 0;
+        last_is_edge_ = false;
+    }
+
+    /** @brief これまでに加えたレポートの数 */
+    uint64_t Reports() const;
+    /** @brief これまでに Add が作った区間の数 Reports() との比がまとめた効果を表す */
+    uint64_t Segments() const;
+
+  private:
+    std::array<Segment, kMaxSegments> segments_{};
+    int num_segments_{ 0 };
+    uint8_t last_buttons_{ 0 };
+    /** @brief 最後の区間がボタンの状態を変えたレポートだけから成るなら true */
+    bool last_is_edge_{ false };
+    uint64_t reports_{ 0 }, segments_total_{ 0 };
+};
@@ -1,8 +1,10 @@
 #include "paging.hpp"
 
+#include <algorithm>
 #include <array>
 
 #include "asmfunc.h"
+#include "error.hpp"
 
 namespace {
     const uint64_t kPageSize4K = 4096;
@@ -12,6 +14,78 @@ namespace {
     alignas(kPageSize4K) std::array<uint64_t, 512> pml4_table;
     alignas(kPageSize4K) std::array<uint64_t, 512> pdp_table;
     alignas(kPageSize4K) std::array<std::array<uint64_t, 512>, kPageDirectoryCount> page_directory;
+
+    /**
+     * @brief 2MiB ページを 4KiB ページに分割するときに使うページテーブル
+     *
+     * SetCacheType はヒープの初期化前にも呼ばれるので静的に確保しておく
+     */
+    const size_t kPageTableCount = 16;
+    alignas(kPageSize4K) std::array<std::array<uint64_t, 512>, kPageTableCount> page_table;
+    size_t num_page_tables = 0;
+
+    const uint32_t kIA32PATMSR = 0x277;
+
+    /** @brief PAT の各エントリに設定するメモリタイプの値 */
+    const uint64_t kPATUncached = 0x00;
+    const uint64_t kPATWriteCombining = 0x01;
+    const uint64_t kPATWriteThrough = 0x04;
+    const uint64_t kPATWriteBack = 0x06;
+    const uint64_t kPATUncachedMinus = 0x07;
+
+    /** @brief ページのエントリで PAT のエントリ番号を決めるビット */
+    const uint64_t kPageWriteThrough = 1u << 3; // PWT
+    const uint64_t kPageCacheDisable = 1u << 4; // PCD
+    const uint64_t kPageLargePAT = 1u << 12;    // PAT (2MiB ページ)
+    const uint64_t kPagePAT = 1u << 7;          // PAT (4KiB ページ)
+
+    const uint64_t kPagePresentWrite = 0x003;
+    const uint64_t kPageSize = 1u << 7; // PS (ページディレクトリのエントリ)
+    const uint64_t kPageAddressMask = 0x000f'ffff'ffff'f000;
+
+    /** @brief メモリタイプを PWT, PCD と、pat_bit で指定した PAT ビットの組に変換する */
+    uint64_t
+    CacheTypeFlags(CacheType type, uint64_t pat_bit) {
+        const auto index = static_cast<uint64_t>(type);
+        uint64_t flags = 0;
+        if (index & 1) {
+            flags |= kPageWriteThrough;
+        }
+        if (index & 2) {
+            flags |= kPageCacheDisable;
+        }
+        if (index & 4) {
+            flags |= pat_bit;
+        }
+        return flags;
+    }
+
+    /**
+     * @brief 2MiB ページのエントリを、同じ範囲とメモリタイプの 4KiB ページ 512 個に置き換える
+     *
+     * 既に分割済みのエントリは何もしない
+     */
+    Error
+    SplitLargePage(uint64_t& entry) {
+        if ((entry & kPageSize) == 0) {
+            return MAKE_ERROR(Error::kSuccess);
+        }
+        if (num_page_tables == kPageTableCount) {
+            return MAKE_ERROR(Error::kNoEnoughMemory);
+        }
+
+        auto& table = page_table[num_page_tables++];
+        const uint64_t base = entry & kPageAddressMask & ~(kPageSize2M - 1);
+        uint64_t flags = (entry & (kPageWriteThrough | kPageCacheDisable)) | kPagePresentWrite;
+        if (entry & kPageLargePAT) {
+            flags |= kPagePAT;
+        }
+        for (int i = 0; i < 512; ++i) {
+            table[i] = base + i * kPageSize4K | flags;
+        }
+        entry = reinterpret_cast<uint64_t>(&table[0]) | kPagePresentWrite;
+        return MAKE_ERROR(Error::kSuccess);
+    }
 }
 
 void
@@ -26,3 +100,55 @@ SetupIdentityPageTable() {
 
     SetCR3(reinterpret_cast<uint64_t>(&pml4_table[0]));
 }
+
+void
+InitializePAT() {
+    // PA0-PA3 は既定値のまま、PA4 を WC に変更する (PA5-PA7 は PA1-PA3 と同じ)
+    const uint64_t pat = kPATWriteBack | kPATWriteThrough << 8 | kPATUncachedMinus << 16 |
+                         kPATUncached << 24 | kPATWriteCombining << 32 |
+                         kPATWriteThrough << 40 | kPATUncachedMinus << 48 | kPATUncached << 56;
+
+    WriteBackAndInvalidateCache();
+    WriteMSR(kIA32PATMSR, pat);
+    SetCR3(GetCR3());
+    WriteBackAndInvalidateCache();
+}
+
+Error
+SetCacheType(uintptr_t base, size_t size, CacheType type) {
+    const uint64_t large_mask = kPageWriteThrough | kPageCacheDisable | kPageLargePAT;
+    const uint64_t large_flags = CacheTypeFlags(type, kPageLargePAT);
+    const uint64_t small_mask = kPageWriteThrough | kPageCacheDisable | kPagePAT;
+    const uint64_t small_flags = CacheTypeFlags(type, kPagePAT);
+
+    const uint64_t map_end = kPageDirectoryCount * kPageSize1G;
+    const uint64_t end = std::min<uint64_t>(base + size, map_end);
+    auto err = MAKE_ERROR(Error::kSuccess);
+    for (uint64_t addr = base & ~(kPageSize4K - 1); addr < end;) {
+        auto& entry = page_directory[addr / kPageSize1G][(addr % kPageSize1G) / kPageSize2M];
+        const uint64_t page_end = (addr & ~(kPageSize2M - 1)) + kPageSize2M;
+        const uint64_t chunk_end = std::min(page_end, end);
+
+        // 2MiB ページ全体が範囲に入るときだけ、分割せずにまとめて変更する
+        if ((entry & kPageSize) && addr % kPageSize2M == 0 && chunk_end == page_end) {
+            entry = (entry & ~large_mask) | large_flags;
+            addr = chunk_end;
+            continue;
+        }
+
+        // 範囲外の部分のメモリタイプを変えないよう、4KiB ページに分割してから変更する
+        if ((err = SplitLargePage(entry))) {
+            break;
+        }
+        auto table = reinterpret_cast<uint64_t*>(entry & kPageAddressMask);
+        for (; addr < chunk_end; addr += kPageSize4K) {
+            auto& page = table[(addr % kPageSize2M) / kPageSize4K];
+            page = (page & ~small_mask) | small_flags;
+        }
+    }
+
+    // 書き換えたページの TLB と、古いメモリタイプでキャッシュされた内容を捨てる
+    SetCR3(GetCR3());
+    WriteBackAndInvalidateCache();
+    return err;
+}
@@ -7,6 +7,9 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+
+#include "error.hpp"
 
 /**
  * @brief 静的に確保するページディレクトリの個数
@@ -23,3 +26,40 @@ const size_t kPageDirectoryCount = 64;
  */
 void
 SetupIdentityPageTable();
+
+/**
+ * @brief ページに設定するメモリタイプ
+ *
+ * 値は InitializePAT で設定する PAT のエントリ番号に対応する
+ */
+enum class CacheType {
+    kWriteBack = 0,
+    kWriteThrough = 1,
+    kUncached = 3,
+    kWriteCombining = 4,
+};
+
+/**
+ * @brief PAT (Page Attribute Table) を設定する
+ *
+ * 電源投入時の既定値のうち PA4 だけを WB から WC に変更する
+ * PA0-PA3 は既定値 (WB, WT, UC-, UC) のままなので、既存のページの属性は変わらない
+ */
+void
+InitializePAT();
+
+/**
+ * @brief 指定された物理アドレス範囲のメモリタイプを変更する
+ *
+ * 2MiB ページの一部だけが範囲に入るときは、そのページを 4KiB ページに分割してから設定する
+ * 範囲の端が 4KiB 境界にないときは、端を含む 4KiB ページ全体が指定したメモリタイプになる
+ * 範囲が恒等マッピングの外にある部分は無視する
+ *
+ * @param base  範囲の先頭の物理アドレス
+ * @param size  範囲のバイト数
+ * @param type  設定するメモリタイプ
+ * @return 分割に使うページテーブルが足りなければ kNoEnoughMemory
+ *         (それまでに処理したページは変更済み)
+ */
+Error
+SetCacheType(uintptr_t base, size_t size, CacheType type);
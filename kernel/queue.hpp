@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <cstddef>
 
 #include "error.hpp"
@@ -88,4 +89,210 @@ template<typename T>
 const T&
 ArrayQueue<T>::Front() const {
     return data_[read_pos_];
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 書き込み側と読み出し側が1つずつのロックフリーなリングバッファ
+ *
+ * 書き込み側は tail_ だけを、読み出し側は head_ だけを書き換えるので、共有するカウンタを持たない
+ * 要素の書き込みは tail_ の release ストアで、読み出し側の acquire ロードに対して公開される
+ * 例えば1つの割り込みハンドラからメインループへ渡すのに使う
+ *
+ * @tparam N  容量 2 のべき乗でなければならない
+ */
+template<typename T, size_t N>
+class SPSCQueue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+  public:
+    Error Push(const T& value);
+    /** @brief values から count 個までを書き込み、書き込めた個数を返す */
+    size_t Push(const T* values, size_t count);
+    Error Pop(T& value);
+    /** @brief values へ max_count 個までを読み出し、読み出した個数を返す */
+    size_t Pop(T* values, size_t max_count);
+    /** @brief 要素数を返す 他方が同時に操作していれば、その前後どちらかの値になる */
+    size_t Count() const;
+    static constexpr size_t Capacity() { return N; }
+
+  private:
+    static constexpr size_t kMask = N - 1;
+    std::array<T, N> data_{};
+    /** @brief 読み出し側と書き込み側で別々のキャッシュラインに置く 巻き戻らない通し番号 */
+    alignas(64) std::atomic<size_t> head_{ 0 };
+    alignas(64) std::atomic<size_t> tail_{ 0 };
+};
+
+template<typename T, size_t N>
+Error
+SPSCQueue<T, N>::Push(const T& value) {
+    return Push(&value, 1) == 1 ? MAKE_ERROR(Error::kSuccess) : MAKE_ERROR(Error::kFull);
+}
+
+template<typename T, size_t N>
+size_t
+SPSCQueue<T, N>::Push(const T* values, size_t count) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t head = head_.load(std::memory_order_acquire);
+    const size_t space = N - (tail - head);
+    if (count > space) {
+        count = space;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        data_[(tail + i) & kMask] = values[i];
+    }
+    tail_.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+template<typename T, size_t N>
+Error
+SPSCQueue<T, N>::Pop(T& value) {
+    return Pop(&value, 1) == 1 ? MAKE_ERROR(Error::kSuccess) : MAKE_ERROR(Error::kEmpty);
+}
+
+template<typename T, size_t N>
+size_t
+SPSCQueue<T, N>::Pop(T* values, size_t max_count) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    size_t count = tail - head;
+    if (count > max_count) {
+        count = max_count;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = data_[(head + i) & kMask];
+    }
+    head_.store(head + count, std::memory_order_release);
+    return count;
+}
+
+template<typename T, size_t N>
+size_t
+SPSCQueue<T, N>::Count() const {
+    // head_ は tail_ を追い越さないので、先に head_ を読めば差は負にならない
+    const size_t head = head_.load(std::memory_order_acquire);
+    return tail_.load(std::memory_order_acquire) - head;
+}
+
+/**
+ * @brief 書き込み側が複数、読み出し側が1つのロックフリーなリングバッファ
+ *
+ * 各要素は通し番号 seq を持ち、書き込み側は tail_ の CAS で位置を予約してから要素を書き、
+ * seq の release ストアで公開する 予約したまま割り込まれた書き込み側がいても、
+ * 他の書き込み側 (割り込みハンドラ) は先へ進めるので待ち合わせは起きない
+ * 読み出し側は公開済みの要素が続く所まで読み出す
+ *
+ * @tparam N  容量 2 のべき乗でなければならない
+ */
+template<typename T, size_t N>
+class MPSCQueue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+  public:
+    MPSCQueue();
+    Error Push(const T& value);
+    /** @brief values から count 個までを順に書き込み、書き込めた個数を返す */
+    size_t Push(const T* values, size_t count);
+    /** @brief 読み出し側だけが呼ぶ */
+    Error Pop(T& value);
+    /** @brief values へ max_count 個までを読み出し、読み出した個数を返す 読み出し側だけが呼ぶ */
+    size_t Pop(T* values, size_t max_count);
+    /** @brief 予約済みの要素数を返す 書き込み中の要素も含む */
+    size_t Count() const;
+    static constexpr size_t Capacity() { return N; }
+
+  private:
+    static constexpr size_t kMask = N - 1;
+    struct Cell {
+        /**
+         * @brief 書き込み側は seq == 位置 なら書き込め、読み出し側は seq == 位置 + 1 なら読み出せる
+         *
+         * 読み出した後は seq を 位置 + N にして、1周後の書き込み側に明け渡す
+         */
+        std::atomic<size_t> seq;
+        T value;
+    };
+    std::array<Cell, N> cells_;
+    alignas(64) std::atomic<size_t> head_{ 0 };
+    alignas(64) std::atomic<size_t> tail_{ 0 };
+};
+
+template<typename T, size_t N>
+MPSCQueue<T, N>::MPSCQueue() {
+    for (size_t i = 0; i < N; ++i) {
+        cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T, size_t N>
+Error
+MPSCQueue<T, N>::Push(const T& value) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells_[pos & kMask];
+        const size_t seq = cell->seq.load(std::memory_order_acquire);
+        const auto diff = static_cast<ptrdiff_t>(seq - pos);
+        if (diff == 0) {
+            if (tail_.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // 1周前の要素がまだ読み出されていない
+            return MAKE_ERROR(Error::kFull);
+        } else {
+            pos = tail_.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->value = value;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+template<typename T, size_t N>
+size_t
+MPSCQueue<T, N>::Push(const T* values, size_t count) {
+    size_t i = 0;
+    for (; i < count; ++i) {
+        if (Push(values[i])) {
+            break;
+        }
+    }
+    return i;
+}
+
+template<typename T, size_t N>
+Error
+MPSCQueue<T, N>::Pop(T& value) {
+    return Pop(&value, 1) == 1 ? MAKE_ERROR(Error::kSuccess) : MAKE_ERROR(Error::kEmpty);
+}
+
+template<typename T, size_t N>
+size_t
+MPSCQueue<T, N>::Pop(T* values, size_t max_count) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    size_t count = 0;
+    for (; count < max_count; ++count) {
+        const size_t pos = head + count;
+        auto& cell = cells_[pos & kMask];
+        if (cell.seq.load(std::memory_order_acquire) != pos + 1) {
+            // 空か、予約された要素の書き込みがまだ終わっていない
+            break;
+        }
+        values[count] = cell.value;
+        cell.seq.store(pos + N, std::memory_order_release);
+    }
+    head_.store(head + count, std::memory_order_release);
+    return count;
+}
+
+template<typename T, size_t N>
+size_t
+MPSCQueue<T, N>::Count() const {
+    // head_ は tail_ を追い越さないので、先に head_ を読めば差は負にならない
+    const size_t head = head_.load(std::memory_order_acquire);
+    return tail_.load(std::memory_order_acquire) - head;
+}
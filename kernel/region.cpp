@@ -0,0 +1,162 @@
+#include "region.hpp"
+
+namespace {
+    /** @brief a から b と重なる部分を除いた残りを、最大4つの重ならない矩形として out に加える */
+    void SubtractRect(const Rectangle<int>& a,
+                      const Rectangle<int>& b,
+                      std::vector<Rectangle<int>>& out) {
+        const auto i = a & b;
+        if (IsEmpty(i)) {
+            out.push_back(a);
+            return;
+        }
+
+        const auto a_end = a.pos + a.size;
+        const auto i_end = i.pos + i.size;
+        if (a.pos.y < i.pos.y) { // 上
+            out.push_back({ a.pos, { a.size.x, i.pos.y - a.pos.y } });
+        }
+        if (i_end.y < a_end.y) { // 下
+            out.push_back({ { a.pos.x, i_end.y }, { a.size.x, a_end.y - i_end.y } });
+        }
+        if (a.pos.x < i.pos.x) { // 左
+            out.push_back({ { a.pos.x, i.pos.y }, { i.pos.x - a.pos.x, i.size.y } });
+        }
+        if (i_end.x < a_end.x) { // 右
+            out.push_back({ { i_end.x, i.pos.y }, { a_end.x - i_end.x, i.size.y } });
+        }
+    }
+
+    /** @brief a と b が辺全体を共有していれば、2つを合わせた矩形を merged に設定して true を返す */
+    bool TryMerge(const Rectangle<int>& a, const Rectangle<int>& b, Rectangle<int>& merged) {
+        const auto a_end = a.pos + a.size;
+        const auto b_end = b.pos + b.size;
+        if (a.pos.x == b.pos.x && a.size.x == b.size.x &&
+            (a_end.y == b.pos.y || b_end.y == a.pos.y)) {
+            merged = { { a.pos.x, std::min(a.pos.y, b.pos.y) }, { a.size.x, a.size.y + b.size.y } };
+            return true;
+        }
+        if (a.pos.y == b.pos.y && a.size.y == b.size.y &&
+            (a_end.x == b.pos.x || b_end.x == a.pos.x)) {
+            merged = { { std::min(a.pos.x, b.pos.x), a.pos.y }, { a.size.x + b.size.x, a.size.y } };
+            return true;
+        }
+        return false;
+    }
+}
+
+Region::Region(const Rectangle<int>& rect) {
+    if (!::IsEmpty(rect)) {
+        rects_.push_back(rect);
+    }
+}
+
+bool
+Region::IsEmpty() const {
+    return rects_.empty();
+}
+
+void
+Region::Clear() {
+    rects_.clear();
+}
+
+const std::vector<Rectangle<int>>&
+Region::Rects() const {
+    return rects_;
+}
+
+Rectangle<int>
+Region::Bounds() const {
+    Rectangle<int> bounds{};
+    for (const auto& rect : rects_) {
+        bounds = bounds | rect;
+    }
+    return bounds;
+}
+
+Region&
+Region::Union(const Rectangle<int>& rect) {
+    if (::IsEmpty(rect)) {
+        return *this;
+    }
+
+    // 既存の矩形と重なる部分を新しい矩形から削ってから加える
+    std::vector<Rectangle<int>> pieces{ rect };
+    std::vector<Rectangle<int>> rest;
+    for (const auto& existing : rects_) {
+        rest.clear();
+        for (const auto& piece : pieces) {
+            SubtractRect(piece, existing, rest);
+        }
+        pieces.swap(rest);
+        if (pieces.empty()) {
+            return *this;
+        }
+    }
+    rects_.insert(rects_.end(), pieces.begin(), pieces.end());
+    Coalesce();
+    return *this;
+}
+
+Region&
+Region::Union(const Region& other) {
+    for (const auto& rect : other.rects_) {
+        Union(rect);
+    }
+    return *this;
+}
+
+Region&
+Region::Intersect(const Rectangle<int>& rect) {
+    std::vector<Rectangle<int>> result;
+    for (const auto& existing : rects_) {
+        const auto i = existing & rect;
+        if (!::IsEmpty(i)) {
+            result.push_back(i);
+        }
+    }
+    rects_.swap(result);
+    return *this;
+}
+
+Region&
+Region::Subtract(const Rectangle<int>& rect) {
+    if (::IsEmpty(rect)) {
+        return *this;
+    }
+    std::vector<Rectangle<int>> result;
+    for (const auto& existing : rects_) {
+        SubtractRect(existing, rect, result);
+    }
+    rects_.swap(result);
+    Coalesce();
+    return *this;
+}
+
+Region&
+Region::Subtract(const Region& other) {
+    for (const auto& rect : other.rects_) {
+        Subtract(rect);
+    }
+    return *this;
+}
+
+void
+Region::Coalesce() {
+    bool merged_any = true;
+    while (merged_any) {
+        merged_any = false;
+        for (size_t i = 0; i < rects_.size() && !merged_any; ++i) {
+            for (size_t j = i + 1; j < rects_.size(); ++j) {
+                Rectangle<int> merged;
+                if (TryMerge(rects_[i], rects_[j], merged)) {
+                    rects_[i] = merged;
+                    rects_.erase(rects_.begin() + j);
+                    merged_any = true;
+                    break;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,56 @@
+/**
+ * @file region.hpp
+ *
+ * 重なりのない矩形の集合で表した領域を提供する
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "graphics.hpp"
+
+/** @brief 矩形の大きさが0なら true を返す */
+inline bool
+IsEmpty(const Rectangle<int>& rect) {
+    return rect.size.x <= 0 || rect.size.y <= 0;
+}
+
+/**
+ * @brief Regionは互いに重ならない矩形の和集合で表した領域
+ *
+ * 再描画が必要な範囲を集めるために使う
+ * 各矩形は重ならないので、Rects() の矩形を順に処理すれば各ピクセルをちょうど1回ずつ扱える
+ */
+class Region {
+  public:
+    Region() = default;
+    /** @brief 1つの矩形からなる領域を作る */
+    Region(const Rectangle<int>& rect);
+
+    /** @brief 領域が空なら true を返す */
+    bool IsEmpty() const;
+    /** @brief 領域を空にする */
+    void Clear();
+    /** @brief 領域を構成する互いに重ならない矩形の列を返す */
+    const std::vector<Rectangle<int>>& Rects() const;
+    /** @brief 領域全体を含む最小の矩形を返す */
+    Rectangle<int> Bounds() const;
+
+    /** @brief 指定した矩形を領域に加える */
+    Region& Union(const Rectangle<int>& rect);
+    /** @brief 指定した領域を領域に加える */
+    Region& Union(const Region& other);
+    /** @brief 領域を指定した矩形との共通部分に狭める */
+    Region& Intersect(const Rectangle<int>& rect);
+    /** @brief 指定した矩形と重なる部分を領域から取り除く */
+    Region& Subtract(const Rectangle<int>& rect);
+    /** @brief 指定した領域と重なる部分を領域から取り除く */
+    Region& Subtract(const Region& other);
+
+  private:
+    std::vector<Rectangle<int>> rects_{};
+
+    /** @brief 辺を共有して1つの矩形にまとめられる矩形同士を結合する */
+    void Coalesce();
+};
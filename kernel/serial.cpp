@@ -0,0 +1,151 @@
+/**
+ * @file serial.cpp
+ *
+ * COM1 の 16550 UART を使うシリアルポートのドライバのプログラムを集めたファイル
+ */
+
+#include "serial.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "asmfunc.h"
+
+namespace {
+    const uint16_t kCOM1 = 0x3f8;
+    const uint16_t kTHR = kCOM1 + 0; // 送信 (DLAB = 0)
+    const uint16_t kRBR = kCOM1 + 0; // 受信 (DLAB = 0)
+    const uint16_t kDLL = kCOM1 + 0; // 分周比の下位 (DLAB = 1)
+    const uint16_t kIER = kCOM1 + 1; // 割り込み許可 (DLAB = 0)
+    const uint16_t kDLM = kCOM1 + 1; // 分周比の上位 (DLAB = 1)
+    const uint16_t kIIR = kCOM1 + 2; // 割り込み要因 (読み出し)
+    const uint16_t kFCR = kCOM1 + 2; // FIFO 制御 (書き込み)
+    const uint16_t kLCR = kCOM1 + 3;
+    const uint16_t kMCR = kCOM1 + 4;
+    const uint16_t kLSR = kCOM1 + 5;
+
+    const uint8_t kLCRDLAB = 0x80;
+    const uint8_t kLCR8N1 = 0x03;
+    const uint8_t kFCREnableAndClear = 0xc7;
+    const uint8_t kMCRLoopback = 0x1e;
+    const uint8_t kMCRDTRRTSOut2 = 0x0b; // OUT2 が立っていないと割り込みが出ない
+    const uint8_t kIERTransmitEmpty = 0x02;
+    const uint8_t kLSRTransmitEmpty = 0x20;
+
+    /** @brief 送信 FIFO の段数 */
+    const int kFIFOSize = 16;
+    /** @brief 送信用のリングバッファのバイト数 2 のべき乗とする */
+    const size_t kTxRingSize = 16 * 1024;
+
+    uint8_t tx_ring[kTxRingSize];
+    /**
+     * @brief 書き込み側が書き終えた位置と、UART へ送り終えた位置
+     *
+     * どちらも巻き戻らない通し番号で、tx_tail は割り込みを禁止した状態でだけ進める
+     */
+    std::atomic<size_t> tx_head{ 0 }, tx_tail{ 0 };
+    bool available = false;
+
+    /** @brief 送信 FIFO が空なら、リングバッファから FIFO の段数分を UART へ送る */
+    void __attribute__((no_caller_saved_registers)) TransmitFromRing() {
+        if ((IoIn8(kLSR) & kLSRTransmitEmpty) == 0) {
+            return;
+        }
+        size_t tail = tx_tail.load(std::memory_order_relaxed);
+        const size_t head = tx_head.load(std::memory_order_acquire);
+        for (int i = 0; i < kFIFOSize && tail != head; ++i, ++tail) {
+            IoOut8(kTHR, tx_ring[tail & (kTxRingSize - 1)]);
+        }
+        tx_tail.store(tail, std::memory_order_release);
+    }
+
+    /**
+     * @brief 割り込みを禁止して TransmitFromRing を呼ぶ
+     *
+     * FIFO が空のまま止まっている送信を再開させるのにも使う
+     * 割り込みハンドラとの競合を避けるため、リングバッファの読み出しは割り込み禁止中に行う
+     */
+    void Kick() {
+        uint64_t rflags;
+        __asm__ volatile("pushfq; pop %0; cli" : "=r"(rflags)::"memory");
+        TransmitFromRing();
+        if (rflags & (1u << 9)) { // IF
+            __asm__ volatile("sti" ::: "memory");
+        }
+    }
+}
+
+bool
+InitializeSerial() {
+    IoOut8(kIER, 0);
+    IoOut8(kLCR, kLCRDLAB);
+    IoOut8(kDLL, 1); // 115200 / 1 bps
+    IoOut8(kDLM, 0);
+    IoOut8(kLCR, kLCR8N1);
+    IoOut8(kFCR, kFCREnableAndClear);
+
+    // ループバックで書いた値が読めなければ UART は無い
+    IoOut8(kMCR, kMCRLoopback);
+    IoOut8(kTHR, 0xae);
+    if (IoIn8(kRBR) != 0xae) {
+        return false;
+    }
+
+    IoOut8(kMCR, kMCRDTRRTSOut2);
+    IoOut8(kIER, kIERTransmitEmpty);
+    available = true;
+    return true;
+}
+
+bool
+SerialAvailable() {
+    return available;
+}
+
+void
+SerialWrite(const void* data, size_t size) {
+    if (!available) {
+        return;
+    }
+
+    auto p = reinterpret_cast<const uint8_t*>(data);
+    while (size > 0) {
+        const size_t head = tx_head.load(std::memory_order_relaxed);
+        const size_t space = kTxRingSize - (head - tx_tail.load(std::memory_order_acquire));
+        if (space == 0) {
+            Kick();
+            continue;
+        }
+
+        const size_t n = size < space ? size : space;
+        for (size_t i = 0; i < n; ++i) {
+            tx_ring[(head + i) & (kTxRingSize - 1)] = p[i];
+        }
+        tx_head.store(head + n, std::memory_order_release);
+        p += n;
+        size -= n;
+    }
+    Kick();
+}
+
+void
+SerialWriteString(const char* s) {
+    SerialWrite(s, strlen(s));
+}
+
+void
+SerialFlush() {
+    if (!available) {
+        return;
+    }
+    while (tx_tail.load(std::memory_order_acquire) != tx_head.load(std::memory_order_relaxed)) {
+        Kick();
+    }
+}
+
+void __attribute__((no_caller_saved_registers))
+SerialOnInterrupt() {
+    IoIn8(kIIR); // 読み出すと送信完了の割り込み要因が消える
+    TransmitFromRing();
+}
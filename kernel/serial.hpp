@@ -0,0 +1,43 @@
+/**
+ * @file serial.hpp
+ *
+ * COM1 の 16550 UART から、割り込みを使って送信するシリアルポートのドライバを提供する
+ */
+
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief COM1 を 115200bps 8N1、FIFO 有効で初期化する
+ *
+ * ループバックで UART の存在を確かめ、見つからなければ以降の書き込みは何もしない
+ * 送信完了の割り込みは IRQ 4 に出るので、呼び出し側で I/O APIC の設定をする
+ *
+ * @return UART が見つかれば true
+ */
+bool
+InitializeSerial();
+/** @brief UART が見つかっていれば true を返す */
+bool
+SerialAvailable();
+
+/**
+ * @brief 送信用のリングバッファに data を加える
+ *
+ * 送信は UART の割り込みで進む リングバッファが一杯なら割り込みを待たずに
+ * UART へ直接書き出して空きを作るので、データを捨てることはない
+ * メインループが F12 で DumpTrace を、F11 で統計をまとめて書き出すのにも使う
+ * 書き込み側は1つだけとし、割り込みハンドラからは呼ばないこと
+ */
+void
+SerialWrite(const void* data, size_t size);
+/** @brief '\0' で終わる文字列を SerialWrite する */
+void
+SerialWriteString(const char* s);
+/** @brief 送信用のリングバッファが空になるまで、割り込みを待たずに送信する パニック時に使う */
+void
+SerialFlush();
+/** @brief UART の割り込みを処理する COM1 の割り込みハンドラから呼ぶ */
+void __attribute__((no_caller_saved_registers))
+SerialOnInterrupt();
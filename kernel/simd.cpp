@@ -0,0 +1,299 @@
+/**
+ * @file simd.cpp
+ *
+ * SSE/AVX の有効化と、32 ビットピクセル列を扱う SIMD カーネルのプログラムを集めたファイル
+ */
+
+#include "simd.hpp"
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include "asmfunc.h"
+#include "interrupt.hpp"
+
+namespace {
+    const uint64_t kCR0MonitorCoprocessor = 1u << 1; // MP
+    const uint64_t kCR0Emulation = 1u << 2;          // EM
+    const uint64_t kCR4OSFXSR = 1u << 9;
+    const uint64_t kCR4OSXMMEXCPT = 1u << 10;
+    const uint64_t kCR4OSXSAVE = 1u << 18;
+
+    const uint64_t kXCR0X87 = 1u << 0;
+    const uint64_t kXCR0SSE = 1u << 1;
+    const uint64_t kXCR0AVX = 1u << 2;
+
+    const uint32_t kCPUID1EDXSSE2 = 1u << 26;
+    const uint32_t kCPUID1ECXXSAVE = 1u << 26;
+    const uint32_t kCPUID1ECXAVX = 1u << 28;
+    const uint32_t kCPUID7EBXAVX2 = 1u << 5;
+
+    /** @brief FXSAVE の保存領域のバイト数 */
+    const size_t kFXSaveAreaSize = 512;
+
+    void Fill32Scalar(uint32_t* dst, uint32_t value, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = value;
+        }
+    }
+
+    void Copy32Scalar(uint32_t* dst, const uint32_t* src, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = src[i];
+        }
+    }
+
+    uint32_t SwapRB(uint32_t v) {
+        return (v & 0xff00ff00u) | ((v >> 16) & 0xffu) | ((v & 0xffu) << 16);
+    }
+
+    void SwapRB32Scalar(uint32_t* dst, const uint32_t* src, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = SwapRB(src[i]);
+        }
+    }
+
+    void Fill32SSE2(uint32_t* dst, uint32_t value, size_t count) {
+        const __m128i v = _mm_set1_epi32(value);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), v);
+        }
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        }
+        Fill32Scalar(dst + i, value, count - i);
+    }
+
+    void Copy32SSE2(uint32_t* dst, const uint32_t* src, size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), a);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), b);
+        }
+        for (; i + 4 <= count; i += 4) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), a);
+        }
+        Copy32Scalar(dst + i, src + i, count - i);
+    }
+
+    void SwapRB32SSE2(uint32_t* dst, const uint32_t* src, size_t count) {
+        // SSE2 には pshufb が無いので、マスクとシフトでバイト 0 と 2 を入れ替える
+        const __m128i keep = _mm_set1_epi32(0xff00ff00);
+        const __m128i low = _mm_set1_epi32(0x000000ff);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i r = _mm_or_si128(
+                _mm_and_si128(v, keep),
+                _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), low),
+                             _mm_slli_epi32(_mm_and_si128(v, low), 16)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+        }
+        SwapRB32Scalar(dst + i, src + i, count - i);
+    }
+
+    __attribute__((target("avx2"))) void Fill32AVX2(uint32_t* dst, uint32_t value, size_t count) {
+        const __m256i v = _mm256_set1_epi32(value);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8), v);
+        }
+        for (; i + 8 <= count; i += 8) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+        }
+        Fill32Scalar(dst + i, value, count - i);
+    }
+
+    __attribute__((target("avx2"))) void Copy32AVX2(uint32_t* dst,
+                                                    const uint32_t* src,
+                                                    size_t count) {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 8));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), a);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8), b);
+        }
+        for (; i + 8 <= count; i += 8) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), a);
+        }
+        Copy32Scalar(dst + i, src + i, count - i);
+    }
+
+    __attribute__((target("avx2"))) void SwapRB32AVX2(uint32_t* dst,
+                                                      const uint32_t* src,
+                                                      size_t count) {
+        const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                                 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                                _mm256_shuffle_epi8(v, shuffle));
+        }
+        SwapRB32Scalar(dst + i, src + i, count - i);
+    }
+
+    SIMDLevel simd_level = SIMDLevel::kScalar;
+    void (*fill32)(uint32_t*, uint32_t, size_t) = Fill32Scalar;
+    void (*copy32)(uint32_t*, const uint32_t*, size_t) = Copy32Scalar;
+    void (*swap_rb32)(uint32_t*, const uint32_t*, size_t) = SwapRB32Scalar;
+
+    /**
+     * @brief 割り込みハンドラが使う保存領域のバイト数
+     *
+     * XCR0 では x87/SSE/AVX しか有効にしないので、その保存領域 (1 KiB 弱) が収まればよい
+     */
+    const size_t kInterruptSIMDStateSize = 4096;
+    /** @brief 割り込みの深さ 1, 2, ... ごとの保存領域 */
+    alignas(64) uint8_t interrupt_simd_state[InterruptSIMDGuard::kMaxInterruptNesting]
+                                            [kInterruptSIMDStateSize];
+
+    /** @brief XSAVE で保存する状態コンポーネント 0 なら FXSAVE を使う */
+    uint64_t xsave_mask = 0;
+    size_t simd_state_size = kFXSaveAreaSize;
+}
+
+void
+InitializeSIMD() {
+    unsigned int eax, ebx, ecx, edx;
+    __cpuid(1, eax, ebx, ecx, edx);
+    const bool has_sse2 = edx & kCPUID1EDXSSE2;
+    const bool has_xsave = ecx & kCPUID1ECXXSAVE;
+    const bool has_avx = ecx & kCPUID1ECXAVX;
+
+    // x87/SSE 命令を例外なしで実行できるようにする
+    SetCR0((GetCR0() & ~kCR0Emulation) | kCR0MonitorCoprocessor);
+    uint64_t cr4 = GetCR4() | kCR4OSFXSR | kCR4OSXMMEXCPT;
+    if (has_xsave) {
+        cr4 |= kCR4OSXSAVE;
+    }
+    SetCR4(cr4);
+
+    bool avx_enabled = false;
+    if (has_xsave) {
+        // 割り込みハンドラの保存領域に収まるよう、使う状態コンポーネントだけを有効にする
+        uint64_t xcr0 = kXCR0X87 | kXCR0SSE;
+        if (has_avx) {
+            xcr0 |= kXCR0AVX;
+        }
+        XSetBV(0, xcr0);
+        avx_enabled = xcr0 & kXCR0AVX;
+
+        xsave_mask = xcr0;
+        // EBX は現在の XCR0 で有効な状態を保存するのに必要なバイト数
+        __cpuid_count(0xd, 0, eax, ebx, ecx, edx);
+        simd_state_size = ebx;
+    }
+
+    bool has_avx2 = false;
+    if (avx_enabled) {
+        __cpuid(0, eax, ebx, ecx, edx);
+        if (eax >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            has_avx2 = ebx & kCPUID7EBXAVX2;
+        }
+    }
+
+    if (has_avx2) {
+        simd_level = SIMDLevel::kAVX2;
+        fill32 = Fill32AVX2;
+        copy32 = Copy32AVX2;
+        swap_rb32 = SwapRB32AVX2;
+    } else if (has_sse2) {
+        simd_level = SIMDLevel::kSSE2;
+        fill32 = Fill32SSE2;
+        copy32 = Copy32SSE2;
+        swap_rb32 = SwapRB32SSE2;
+    }
+}
+
+SIMDLevel
+CurrentSIMDLevel() {
+    return simd_level;
+}
+
+size_t
+SIMDStateSize() {
+    return simd_state_size;
+}
+
+void __attribute__((no_caller_saved_registers))
+SaveSIMDState(void* area) {
+    if (xsave_mask) {
+        XSave(area, xsave_mask);
+    } else {
+        FXSave(area);
+    }
+}
+
+void __attribute__((no_caller_saved_registers))
+RestoreSIMDState(const void* area) {
+    if (xsave_mask) {
+        XRstor(area, xsave_mask);
+    } else {
+        FXRstor(area);
+    }
+}
+
+InterruptSIMDGuard::InterruptSIMDGuard() {
+    // InterruptScope が先に作られているので、深さは 1 以上になっている
+    const int depth = interrupt_depth;
+    if (depth < 1 || depth > kMaxInterruptNesting) {
+        // 保存領域を共有すると割り込まれた側の状態を壊すので、先へ進まずに止める
+        while (true) {
+            __asm__ volatile("cli\n\thlt");
+        }
+    }
+    area_ = interrupt_simd_state[depth - 1];
+    SaveSIMDState(area_);
+}
+
+InterruptSIMDGuard::~InterruptSIMDGuard() {
+    RestoreSIMDState(area_);
+}
+
+void
+Fill32(uint32_t* dst, uint32_t value, size_t count) {
+    fill32(dst, value, count);
+}
+
+void
+Copy32(uint32_t* dst, const uint32_t* src, size_t count) {
+    copy32(dst, src, count);
+}
+
+void
+SwapRB32(uint32_t* dst, const uint32_t* src, size_t count) {
+    swap_rb32(dst, src, count);
+}
+
+void
+StreamCopy32(uint32_t* dst, const uint32_t* src, size_t count) {
+    // movntdq は 16 バイト境界の書き込み先を要求するので、先頭は movnti で揃える
+    size_t i = 0;
+    for (; i < count && (reinterpret_cast<uintptr_t>(dst + i) & 0xf); ++i) {
+        _mm_stream_si32(reinterpret_cast<int*>(dst + i), src[i]);
+    }
+    for (; i + 8 <= count; i += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), a);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + 4), b);
+    }
+    for (; i < count; ++i) {
+        _mm_stream_si32(reinterpret_cast<int*>(dst + i), src[i]);
+    }
+}
+
+void
+StreamFence() {
+    _mm_sfence();
+}
@@ -0,0 +1,98 @@
+/**
+ * @file simd.hpp
+ *
+ * SSE/AVX の有効化と、32 ビットピクセル列を扱う SIMD カーネルを提供する
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** @brief 実行時に選択されたピクセル列操作の実装 */
+enum class SIMDLevel {
+    kScalar,
+    kSSE2,
+    kAVX2,
+};
+
+/**
+ * @brief SSE/AVX を使えるように CR0/CR4/XCR0 を設定し、最適なカーネルを選択する
+ *
+ * CPUID で SSE2/AVX2 の有無を調べ、使える中で最も速い実装を
+ * Fill32/Copy32/SwapRB32 の呼び出し先とする
+ * 呼び出す前はスカラー実装が使われる
+ */
+void
+InitializeSIMD();
+
+/** @brief InitializeSIMD で選択された実装を返す */
+SIMDLevel
+CurrentSIMDLevel();
+
+/** @brief SaveSIMDState/RestoreSIMDState が必要とする保存領域のバイト数を返す */
+size_t
+SIMDStateSize();
+
+/**
+ * @brief x87/SSE/AVX のレジスタ状態を保存する
+ *
+ * @param area  SIMDStateSize() バイト以上で 64 バイト境界に揃った保存領域
+ */
+void __attribute__((no_caller_saved_registers))
+SaveSIMDState(void* area);
+
+/** @brief SaveSIMDState で保存したレジスタ状態を復元する */
+void __attribute__((no_caller_saved_registers))
+RestoreSIMDState(const void* area);
+
+/**
+ * @brief 割り込みハンドラの間、割り込まれた処理の x87/SSE/AVX レジスタ状態を保存・復元する
+ *
+ * 割り込みハンドラの先頭で InterruptScope の次に作り、ハンドラを抜けるときに壊す
+ * clang の interrupt 属性は関数自身が使う XMM レジスタしか退避せず、YMM の上位は扱わないので、
+ * ピクセル列操作の途中で割り込まれても状態が壊れないようにここで丸ごと保存する
+ * 保存領域は割り込みの深さごとに持つので、kMaxInterruptNesting 段までのネストに耐える
+ */
+class InterruptSIMDGuard {
+  public:
+    /** @brief 保存領域を持つ割り込みの深さの上限 これを超えたら CPU を止める */
+    static const int kMaxInterruptNesting = 4;
+
+    __attribute__((no_caller_saved_registers)) InterruptSIMDGuard();
+    __attribute__((no_caller_saved_registers)) ~InterruptSIMDGuard();
+    InterruptSIMDGuard(const InterruptSIMDGuard&) = delete;
+    InterruptSIMDGuard& operator=(const InterruptSIMDGuard&) = delete;
+
+  private:
+    void* area_;
+};
+
+/** @brief dst から count 個の 32 ビットピクセルを value で埋める */
+void
+Fill32(uint32_t* dst, uint32_t value, size_t count);
+
+/** @brief src から dst へ count 個の 32 ビットピクセルをコピーする 領域は重なってはならない */
+void
+Copy32(uint32_t* dst, const uint32_t* src, size_t count);
+
+/**
+ * @brief src から dst へ count 個の 32 ビットピクセルを、バイト 0 と 2 を入れ替えながらコピーする
+ *
+ * kPixelRGBResv8BitPerColor と kPixelBGRResv8BitPerColor の相互変換に用いる
+ */
+void
+SwapRB32(uint32_t* dst, const uint32_t* src, size_t count);
+
+/**
+ * @brief src から dst へ count 個の 32 ビットピクセルを、キャッシュを汚さない書き込みでコピーする
+ *
+ * movntdq/movnti を使うので dst の内容はキャッシュに載らない
+ * 書き込みの完了を保証するには、一連のコピーの後に StreamFence を呼ぶ
+ */
+void
+StreamCopy32(uint32_t* dst, const uint32_t* src, size_t count);
+
+/** @brief それまでの StreamCopy32 による書き込みを完了させる (sfence) */
+void
+StreamFence();
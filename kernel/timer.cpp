@@ -1,11 +1,24 @@
 #include "timer.hpp"
 
+#include "asmfunc.h"
+
 namespace {
     const uint32_t kCountMax = 0xffffffffu;
     volatile uint32_t& lvt_timer = *reinterpret_cast<uint32_t*>(0xfee00320);
     volatile uint32_t& initial_count = *reinterpret_cast<uint32_t*>(0xfee00380);
     volatile uint32_t& current_count = *reinterpret_cast<uint32_t*>(0xfee00390);
     volatile uint32_t& divide_config = *reinterpret_cast<uint32_t*>(0xfee003e0);
+
+    const uint32_t kPITFrequency = 1193182;
+    const uint16_t kPITChannel2 = 0x42;
+    const uint16_t kPITCommand = 0x43;
+    /** @brief bit 0 がチャネル 2 のゲート、bit 1 がスピーカー出力、bit 5 がチャネル 2 の出力 */
+    const uint16_t kPITGateControl = 0x61;
+    /** @brief キャリブレーションで PIT に数えさせる時間 (ミリ秒) カウンタは 16 ビット */
+    const uint32_t kCalibrationMillis = 50;
+
+    uint64_t lapic_timer_frequency = 0;
+    uint64_t tsc_frequency = 0;
 }
 
 void
@@ -28,3 +41,54 @@ void
 StopLAPICTimer() {
     initial_count = 0;
 }
+
+void
+CalibrateLAPICTimer() {
+    const uint16_t pit_count = kPITFrequency * kCalibrationMillis / 1000;
+    InitializeLAPICTimer();
+
+    // チャネル 2 のゲートを開き、スピーカーへは出力しない
+    IoOut8(kPITGateControl, (IoIn8(kPITGateControl) & ~0x02) | 0x01);
+    // チャネル 2, 下位・上位バイトの順に書き込む, モード 0 (カウント終了で出力が 1 になる)
+    IoOut8(kPITCommand, 0b10110000);
+    IoOut8(kPITChannel2, pit_count & 0xff);
+    IoOut8(kPITChannel2, pit_count >> 8);
+
+    // 上位バイトを書き込んだ時点で PIT は数え始める
+    StartLAPICTimer();
+    const uint64_t tsc_start = ReadTSC();
+    while ((IoIn8(kPITGateControl) & 0x20) == 0) {
+    }
+    const uint32_t elapsed = LAPICTimerElapsed();
+    const uint64_t tsc_end = ReadTSC();
+    StopLAPICTimer();
+
+    lapic_timer_frequency = static_cast<uint64_t>(elapsed) * 1000 / kCalibrationMillis;
+    tsc_frequency = (tsc_end - tsc_start) * 1000 / kCalibrationMillis;
+}
+
+uint64_t
+LAPICTimerFrequency() {
+    return lapic_timer_frequency;
+}
+
+uint64_t
+TSCFrequency() {
+    return tsc_frequency;
+}
+
+uint64_t
+TSCToMicros(uint64_t tsc) {
+    return tsc_frequency ? tsc * 1000000 / tsc_frequency : 0;
+}
+
+void
+StartLAPICTimerPeriodic(unsigned int frequency, uint8_t vector) {
+    uint64_t count = lapic_timer_frequency / frequency;
+    if (count > kCountMax) {
+        count = kCountMax;
+    }
+    divide_config = 0b1011;             // divide 1:1
+    lvt_timer = (0b010 << 16) | vector; // not-masked, periodic
+    initial_count = count;
+}
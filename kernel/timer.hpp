@@ -10,3 +10,27 @@ uint32_t
 LAPICTimerElapsed();
 void
 StopLAPICTimer();
+
+/**
+ * @brief PIT を基準に Local APIC タイマと TSC の周波数を測る
+ *
+ * Local APIC タイマを単発モードで使うので、周期的な割り込みを始める前に呼ぶ
+ */
+void
+CalibrateLAPICTimer();
+/** @brief CalibrateLAPICTimer で測った Local APIC タイマの周波数 (Hz) */
+uint64_t
+LAPICTimerFrequency();
+/** @brief CalibrateLAPICTimer で測った TSC の周波数 (Hz) */
+uint64_t
+TSCFrequency();
+/** @brief TSC のカウント数をマイクロ秒に換算する 校正前は 0 を返す */
+uint64_t
+TSCToMicros(uint64_t tsc);
+/**
+ * @brief Local APIC タイマを周期モードにし、frequency Hz で vector の割り込みを発生させる
+ *
+ * 以後 StartLAPICTimer/LAPICTimerElapsed は使えない
+ */
+void
+StartLAPICTimerPeriodic(unsigned int frequency, uint8_t vector);
@@ -0,0 +1,131 @@
+/**
+ * @file trace.cpp
+ *
+ * バイナリトレースの記録と出力のプログラムを集めたファイル
+ */
+
+#include "trace.hpp"
+
+#include <atomic>
+#include <cpuid.h>
+
+#include "asmfunc.h"
+#include "format.hpp"
+
+namespace {
+    /** @brief リングバッファを用意するCPUの数 */
+    const uint32_t kMaxTraceCPUs = 4;
+    /** @brief 1CPUあたりのイベント数 2 のべき乗とする */
+    const uint64_t kTraceRecordsPerCPU = 4096;
+
+    const uint32_t kMSRTSCAux = 0xc0000103;
+    const uint32_t kCPUID80000001EDXRDTSCP = 1u << 27;
+
+    const char* const kTraceEventNames[kNumTraceEvents] = {
+        "xhci_interrupt",
+        "serial_interrupt",
+        "process_event_begin",
+        "process_event_end",
+        "layer_flush_begin",
+        "layer_flush_end",
+        "compose_begin",
+        "compose_end",
+        "mouse_event",
+        "cursor_update",
+        "frame_begin",
+        "frame_end",
+        "frame_tick",
+        "idle_begin",
+        "idle_end",
+    };
+
+    struct TraceRing {
+        TraceRecord records[kTraceRecordsPerCPU];
+        /** @brief 次に書き込む位置 巻き戻らない通し番号 */
+        std::atomic<uint64_t> next;
+    };
+
+    TraceRing trace_rings[kMaxTraceCPUs];
+    /** @brief rdtscp が使えれば、IA32_TSC_AUX に入れたCPU番号をタイムスタンプと同時に得る */
+    bool has_rdtscp = false;
+}
+
+uint32_t trace_categories = 0;
+
+void
+InitializeTrace(uint32_t cpu) {
+    unsigned int eax, ebx, ecx, edx;
+    __cpuid(0x80000000, eax, ebx, ecx, edx);
+    if (eax >= 0x80000001) {
+        __cpuid(0x80000001, eax, ebx, ecx, edx);
+        has_rdtscp = edx & kCPUID80000001EDXRDTSCP;
+    }
+    if (has_rdtscp) {
+        WriteMSR(kMSRTSCAux, cpu);
+    }
+}
+
+void
+EnableTrace(uint32_t categories) {
+    __atomic_or_fetch(&trace_categories, categories, __ATOMIC_RELAXED);
+}
+
+void
+DisableTrace(uint32_t categories) {
+    __atomic_and_fetch(&trace_categories, ~categories, __ATOMIC_RELAXED);
+}
+
+void __attribute__((no_caller_saved_registers))
+RecordTrace(TraceEvent event, uint64_t arg0, uint64_t arg1) {
+    uint32_t cpu = 0;
+    const uint64_t tsc = has_rdtscp ? ReadTSCP(&cpu) : ReadTSC();
+    auto& ring = trace_rings[cpu % kMaxTraceCPUs];
+
+    // 割り込みで入れ子になっても別の要素を使うよう、位置はアトミックに進める
+    const uint64_t i = ring.next.fetch_add(1, std::memory_order_relaxed);
+    auto& record = ring.records[i & (kTraceRecordsPerCPU - 1)];
+    record.tsc = tsc;
+    record.event = event;
+    record.cpu = cpu;
+    record.arg0 = arg0;
+    record.arg1 = arg1;
+}
+
+void
+DumpTrace(void (*write)(const char* line)) {
+    const uint32_t categories = trace_categories;
+    DisableTrace(kTraceAllCategories);
+
+    char line[128];
+    FormatString(line,
+                 sizeof(line),
+                 "# trace cpus=%u records=%lu\n",
+                 kMaxTraceCPUs,
+                 kTraceRecordsPerCPU);
+    write(line);
+    for (int event = 0; event < kNumTraceEvents; ++event) {
+        FormatString(line, sizeof(line), "E %d %s\n", event, kTraceEventNames[event]);
+        write(line);
+    }
+
+    for (uint32_t cpu = 0; cpu < kMaxTraceCPUs; ++cpu) {
+        const auto& ring = trace_rings[cpu];
+        const uint64_t next = ring.next.load(std::memory_order_relaxed);
+        const uint64_t begin = next > kTraceRecordsPerCPU ? next - kTraceRecordsPerCPU : 0;
+        for (uint64_t i = begin; i < next; ++i) {
+            const auto& record = ring.records[i & (kTraceRecordsPerCPU - 1)];
+            FormatString(line,
+                         sizeof(line),
+                         "R %u %lx %u %lx %lx\n",
+                         record.cpu,
+                         record.tsc,
+                         record.event,
+                         record.arg0,
+                         record.arg1);
+            write(line);
+        }
+    }
+    write("# end\n");
+
+    EnableTrace(categories);
+}
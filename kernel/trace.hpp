@@ -0,0 +1,128 @@
+/**
+ * @file trace.hpp
+ *
+ * ホットパスの所要時間を調べるための、タイムスタンプ付きのバイナリトレースを提供する
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/** @brief トレースのカテゴリ カテゴリごとに実行時に記録の有無を切り替える */
+enum TraceCategory : uint32_t {
+    kTraceInterrupt = 1u << 0,
+    kTraceXHCI = 1u << 1,
+    kTraceCompositor = 1u << 2,
+    kTraceMouse = 1u << 3,
+    kTraceIdle = 1u << 4,
+    kTraceAllCategories = 0xffffffffu,
+};
+
+/**
+ * @brief トレースイベントの種類
+ *
+ * 名前が Begin/End で終わる組は区間を、それ以外は瞬間の出来事を表す
+ * 末尾のコメントは arg0, arg1 の意味
+ */
+enum TraceEvent : uint32_t {
+    kTraceXHCIInterrupt,         // 割り込みベクタ
+    kTraceSerialInterrupt,       // 割り込みベクタ
+    kTraceProcessEventBegin,     // TRB Type
+    kTraceProcessEventEnd,       // Error::Code
+    kTraceLayerFlushBegin,       //
+    kTraceLayerFlushEnd,         // 再描画した矩形の数
+    kTraceComposeBegin,          // 矩形の数, 最下層のレイヤの位置
+    kTraceComposeEnd,            // 画面へ転送したピクセル数
+    kTraceMouseEvent,            // ボタン, 移動量 (下位 16 ビットが x, 続く 16 ビットが y)
+    kTraceCursorUpdate,          // 画面へ転送したピクセル数
+    kTraceFrameBegin,            // フレーム番号, タイマ割り込みから描画開始までの TSC のカウント数
+    kTraceFrameEnd,              // フレームの描画にかかった TSC のカウント数
+    kTraceFrameTick,             // 割り込みベクタ
+    kTraceIdleBegin,             //
+    kTraceIdleEnd,               // 停止していた TSC のカウント数
+    kNumTraceEvents,
+};
+
+/** @brief リングバッファに記録する1イベント */
+struct TraceRecord {
+    uint64_t tsc;
+    uint32_t event;
+    uint32_t cpu;
+    uint64_t arg0, arg1;
+};
+
+/** @brief 記録するカテゴリの集合 Trace が毎回参照する */
+extern uint32_t trace_categories;
+
+/** @brief イベントが属するカテゴリを返す */
+constexpr TraceCategory
+TraceCategoryOf(TraceEvent event) {
+    switch (event) {
+        case kTraceXHCIInterrupt:
+        case kTraceSerialInterrupt:
+        case kTraceFrameTick:
+            return kTraceInterrupt;
+        case kTraceProcessEventBegin:
+        case kTraceProcessEventEnd:
+            return kTraceXHCI;
+        case kTraceLayerFlushBegin:
+        case kTraceLayerFlushEnd:
+        case kTraceComposeBegin:
+        case kTraceComposeEnd:
+        case kTraceCursorUpdate:
+        case kTraceFrameBegin:
+        case kTraceFrameEnd:
+            return kTraceCompositor;
+        case kTraceMouseEvent:
+            return kTraceMouse;
+        case kTraceIdleBegin:
+        case kTraceIdleEnd:
+            return kTraceIdle;
+        default:
+            return kTraceAllCategories;
+    }
+}
+
+/**
+ * @brief このCPUでトレースを記録する準備をする 各CPUで1回ずつ呼ぶ
+ *
+ * @param cpu  このCPUの番号 記録先のリングバッファを選ぶのに使う
+ */
+void
+InitializeTrace(uint32_t cpu);
+/** @brief 指定したカテゴリの記録を有効にする */
+void
+EnableTrace(uint32_t categories);
+/** @brief 指定したカテゴリの記録を無効にする */
+void
+DisableTrace(uint32_t categories);
+
+/**
+ * @brief イベントを実行中のCPUのリングバッファに記録する
+ *
+ * ロックを取らないので割り込みハンドラからも呼べる
+ * リングバッファが一杯なら最も古いイベントを上書きする
+ */
+void __attribute__((no_caller_saved_registers))
+RecordTrace(TraceEvent event, uint64_t arg0, uint64_t arg1);
+
+/** @brief イベントのカテゴリが有効なら記録する 無効ならほぼ何もしない */
+inline void __attribute__((no_caller_saved_registers))
+Trace(TraceEvent event, uint64_t arg0 = 0, uint64_t arg1 = 0) {
+    if (trace_categories & TraceCategoryOf(event)) {
+        RecordTrace(event, arg0, arg1);
+    }
+}
+
+/**
+ * @brief 記録済みのイベントを1行ずつテキストにして write に渡す
+ *
+ * 出力の形式は tools/trace2json.py が読む
+ *   "# trace cpus=<CPU数> records=<1CPUあたりの記録数>"
+ *   "E <イベント番号> <イベント名>"                      (イベントの種類ごと)
+ *   "R <CPU> <TSC> <イベント番号> <arg0> <arg1>"          (イベントごと 数値は16進)
+ *   "# end"
+ * 出力中は記録を止める
+ */
+void
+DumpTrace(void (*write)(const char* line));
@@ -40,7 +40,7 @@ namespace usb {
 
   Error HIDBaseDriver::OnControlCompleted(EndpointID ep_id, SetupData setup_data,
                                           const void* buf, int len) {
-    Log(kDebug, "HIDBaseDriver::OnControlCompleted: dev %08x, phase = %d, len = %d\n",
+    LOG(kLogUSB, kDebug, "HIDBaseDriver::OnControlCompleted: dev %p, phase = %d, len = %d\n",
         this, initialize_phase_, len);
     if (initialize_phase_ == 1) {
       initialize_phase_ = 2;
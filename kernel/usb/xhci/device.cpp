@@ -27,8 +27,8 @@ namespace {
     return data;
   }
 
-  void Log(LogLevel level, const DataStageTRB& trb) {
-    Log(level,
+  void Log(LogSubsystem subsystem, LogLevel level, const DataStageTRB& trb) {
+    Log(subsystem, level,
         "DataStageTRB: len %d, buf 0x%08lx, dir %d, attr 0x%02x\n",
         trb.bits.trb_transfer_length,
         trb.bits.data_buffer_pointer,
@@ -36,8 +36,8 @@ namespace {
         trb.data[3] & 0x7fu);
   }
 
-  void Log(LogLevel level, const SetupStageTRB& trb) {
-    Log(level,
+  void Log(LogSubsystem subsystem, LogLevel level, const SetupStageTRB& trb) {
+    Log(subsystem, level,
         "  SetupStage TRB: req_type %02x, req %02x, val %02x, ind %02x, len %02x\n",
         trb.bits.request_type,
         trb.bits.request,
@@ -46,9 +46,9 @@ namespace {
         trb.bits.length);
   }
 
-  void Log(LogLevel level, const TransferEventTRB& trb) {
+  void Log(LogSubsystem subsystem, LogLevel level, const TransferEventTRB& trb) {
     if (trb.bits.event_data) {
-      Log(level,
+      Log(subsystem, level,
           "Transfer (value %08lx) completed: %s, residual length %d, slot %d, ep addr %d\n",
           reinterpret_cast<uint64_t>(trb.Pointer()),
           kTRBCompletionCodeToName[trb.bits.completion_code],
@@ -59,7 +59,7 @@ namespace {
     }
 
     TRB* issuer_trb = trb.Pointer();
-    Log(level,
+    Log(subsystem, level,
         "%s completed: %s, residual length %d, slot %d, ep addr %d\n",
         kTRBTypeToName[issuer_trb->bits.trb_type],
         kTRBCompletionCodeToName[trb.bits.completion_code],
@@ -67,11 +67,11 @@ namespace {
         trb.bits.slot_id,
         trb.EndpointID().Address());
     if (auto data_trb = TRBDynamicCast<DataStageTRB>(issuer_trb)) {
-      Log(level, "  ");
-      Log(level, *data_trb);
+      Log(subsystem, level, "  ");
+      Log(subsystem, level, *data_trb);
     } else if (auto setup_trb = TRBDynamicCast<SetupStageTRB>(issuer_trb)) {
-      Log(level, "  ");
-      Log(level, *setup_trb);
+      Log(subsystem, level, "  ");
+      Log(subsystem, level, *setup_trb);
     }
   }
 }
@@ -110,7 +110,7 @@ namespace usb::xhci {
       return err;
     }
 
-    Log(kDebug, "Device::ControlIn: ep addr %d, buf 0x%08x, len %d\n",
+    LOG(kLogUSB, kDebug, "Device::ControlIn: ep addr %d, buf %p, len %d\n",
         ep_id.Address(), buf, len);
     if (ep_id.Number() < 0 || 15 < ep_id.Number()) {
       return MAKE_ERROR(Error::kInvalidEndpointNumber);
@@ -157,7 +157,7 @@ namespace usb::xhci {
       return err;
     }
 
-    Log(kDebug, "Device::ControlOut: ep addr %d, buf 0x%08x, len %d\n",
+    LOG(kLogUSB, kDebug, "Device::ControlOut: ep addr %d, buf %p, len %d\n",
         ep_id.Address(), buf, len);
     if (ep_id.Number() < 0 || 15 < ep_id.Number()) {
       return MAKE_ERROR(Error::kInvalidEndpointNumber);
@@ -227,7 +227,7 @@ namespace usb::xhci {
       return err;
     }
 
-    Log(kDebug, "Device::InterrutpOut: ep addr %d, buf %08lx, len %d, dev %08lx\n",
+    LOG(kLogUSB, kDebug, "Device::InterrutpOut: ep addr %d, buf %p, len %d, dev %p\n",
         ep_id.Address(), buf, len, this);
     return MAKE_ERROR(Error::kNotImplemented);
   }
@@ -237,10 +237,10 @@ namespace usb::xhci {
 
     if (trb.bits.completion_code != 1 /* Success */ &&
         trb.bits.completion_code != 13 /* Short Packet */) {
-      Log(kDebug, trb);
+      LOG(kLogUSB, kDebug, trb);
       return MAKE_ERROR(Error::kTransferFailed);
     }
-    Log(kDebug, trb);
+    LOG(kLogUSB, kDebug, trb);
 
     TRB* issuer_trb = trb.Pointer();
     if (auto normal_trb = TRBDynamicCast<NormalTRB>(issuer_trb)) {
@@ -252,10 +252,10 @@ namespace usb::xhci {
 
     auto opt_setup_stage_trb = setup_stage_map_.Get(issuer_trb);
     if (!opt_setup_stage_trb) {
-      Log(kDebug, "No Corresponding Setup Stage for issuer %s\n",
+      LOG(kLogUSB, kDebug, "No Corresponding Setup Stage for issuer %s\n",
           kTRBTypeToName[issuer_trb->bits.trb_type]);
       if (auto data_trb = TRBDynamicCast<DataStageTRB>(issuer_trb)) {
-        Log(kDebug, *data_trb);
+        LOG(kLogUSB, kDebug, *data_trb);
       }
       return MAKE_ERROR(Error::kNoCorrespondingSetupStage);
     }
@@ -1,6 +1,7 @@
 #include "usb/xhci/xhci.hpp"
 
 #include "logger.hpp"
+#include "trace.hpp"
 #include "usb/setupdata.hpp"
 #include "usb/device.hpp"
 #include "usb/descriptor.hpp"
@@ -87,7 +88,7 @@ namespace {
 
   Error ResetPort(Controller& xhc, Port& port) {
     const bool is_connected = port.IsConnected();
-    Log(kDebug, "ResetPort: port.IsConnected() = %s\n",
+    LOG(kLogUSB, kDebug, "ResetPort: port.IsConnected() = %s\n",
         is_connected ? "true" : "false");
 
     if (!is_connected) {
@@ -112,7 +113,7 @@ namespace {
   Error EnableSlot(Controller& xhc, Port& port) {
     const bool is_enabled = port.IsEnabled();
     const bool reset_completed = port.IsPortResetChanged();
-    Log(kDebug, "EnableSlot: port.IsEnabled() = %s, port.IsPortResetChanged() = %s\n",
+    LOG(kLogUSB, kDebug, "EnableSlot: port.IsEnabled() = %s, port.IsPortResetChanged() = %s\n",
         is_enabled ? "true" : "false",
         reset_completed ? "true" : "false");
 
@@ -129,7 +130,7 @@ namespace {
   }
 
   Error AddressDevice(Controller& xhc, uint8_t port_id, uint8_t slot_id) {
-    Log(kDebug, "AddressDevice: port_id = %d, slot_id = %d\n", port_id, slot_id);
+    LOG(kLogUSB, kDebug, "AddressDevice: port_id = %d, slot_id = %d\n", port_id, slot_id);
 
     xhc.DeviceManager()->AllocDevice(slot_id, xhc.DoorbellRegisterAt(slot_id));
 
@@ -164,7 +165,7 @@ namespace {
   }
 
   Error InitializeDevice(Controller& xhc, uint8_t port_id, uint8_t slot_id) {
-    Log(kDebug, "InitializeDevice: port_id = %d, slot_id = %d\n", port_id, slot_id);
+    LOG(kLogUSB, kDebug, "InitializeDevice: port_id = %d, slot_id = %d\n", port_id, slot_id);
 
     auto dev = xhc.DeviceManager()->FindBySlot(slot_id);
     if (dev == nullptr) {
@@ -178,7 +179,7 @@ namespace {
   }
 
   Error CompleteConfiguration(Controller& xhc, uint8_t port_id, uint8_t slot_id) {
-    Log(kDebug, "CompleteConfiguration: port_id = %d, slot_id = %d\n", port_id, slot_id);
+    LOG(kLogUSB, kDebug, "CompleteConfiguration: port_id = %d, slot_id = %d\n", port_id, slot_id);
 
     auto dev = xhc.DeviceManager()->FindBySlot(slot_id);
     if (dev == nullptr) {
@@ -192,7 +193,7 @@ namespace {
   }
 
   Error OnEvent(Controller& xhc, PortStatusChangeEventTRB& trb) {
-    Log(kDebug, "PortStatusChangeEvent: port_id = %d\n", trb.bits.port_id);
+    LOG(kLogUSB, kDebug, "PortStatusChangeEvent: port_id = %d\n", trb.bits.port_id);
     auto port_id = trb.bits.port_id;
     auto port = xhc.PortAt(port_id);
 
@@ -227,7 +228,7 @@ namespace {
   Error OnEvent(Controller& xhc, CommandCompletionEventTRB& trb) {
     const auto issuer_type = trb.Pointer()->bits.trb_type;
     const auto slot_id = trb.bits.slot_id;
-    Log(kDebug, "CommandCompletionEvent: slot_id = %d, issuer = %s\n",
+    LOG(kLogUSB, kDebug, "CommandCompletionEvent: slot_id = %d, issuer = %s\n",
         trb.bits.slot_id, kTRBTypeToName[issuer_type]);
 
     if (issuer_type == EnableSlotCommandTRB::Type) {
@@ -299,14 +300,14 @@ namespace {
     }
 
     r.bits.hc_os_owned_semaphore = 1;
-    Log(kDebug, "waiting until OS owns xHC...\n");
+    LOG(kLogUSB, kDebug, "waiting until OS owns xHC...\n");
     reg.Write(r);
 
     do {
       r = reg.Read();
     } while (r.bits.hc_bios_owned_semaphore ||
              !r.bits.hc_os_owned_semaphore);
-    Log(kDebug, "OS has owned xHC\n");
+    LOG(kLogUSB, kDebug, "OS has owned xHC\n");
   }
 }
 
@@ -347,7 +348,7 @@ namespace usb::xhci {
     while (op_->USBCMD.Read().bits.host_controller_reset);
     while (op_->USBSTS.Read().bits.controller_not_ready);
 
-    Log(kDebug, "MaxSlots: %u\n", cap_->HCSPARAMS1.Read().bits.max_device_slots);
+    LOG(kLogUSB, kDebug, "MaxSlots: %u\n", cap_->HCSPARAMS1.Read().bits.max_device_slots);
     // Set "Max Slots Enabled" field in CONFIG.
     auto config = op_->CONFIG.Read();
     config.bits.max_device_slots_enabled = kDeviceSize;
@@ -361,11 +362,11 @@ namespace usb::xhci {
       auto scratchpad_buf_arr = AllocArray<void*>(max_scratchpad_buffers, 64, 4096);
       for (int i = 0; i < max_scratchpad_buffers; ++i) {
         scratchpad_buf_arr[i] = AllocMem(4096, 4096, 4096);
-        Log(kDebug, "scratchpad buffer array %d = %p\n",
+        LOG(kLogUSB, kDebug, "scratchpad buffer array %d = %p\n",
             i, scratchpad_buf_arr[i]);
       }
       devmgr_.DeviceContexts()[0] = reinterpret_cast<DeviceContext*>(scratchpad_buf_arr);
-      Log(kInfo, "wrote scratchpad buffer array %p to dev ctx array 0\n",
+      LOG(kLogUSB, kInfo, "wrote scratchpad buffer array %p to dev ctx array 0\n",
           scratchpad_buf_arr);
     }
 
@@ -492,6 +493,7 @@ namespace usb::xhci {
 
     Error err = MAKE_ERROR(Error::kNotImplemented);
     auto event_trb = xhc.PrimaryEventRing()->Front();
+    Trace(kTraceProcessEventBegin, event_trb->bits.trb_type);
     if (auto trb = TRBDynamicCast<TransferEventTRB>(event_trb)) {
       err = OnEvent(xhc, *trb);
     } else if (auto trb = TRBDynamicCast<PortStatusChangeEventTRB>(event_trb)) {
@@ -501,6 +503,7 @@ namespace usb::xhci {
     }
     xhc.PrimaryEventRing()->Pop();
 
+    Trace(kTraceProcessEventEnd, err.Cause());
     return err;
   }
 }
@@ -1,54 +1,78 @@
 #include "window.hpp"
 #include "font.hpp"
-#include "logger.hpp"
 
-Window::Window(int width, int height, PixelFormat shadow_format)
+#include <algorithm>
+
+Window::Window(int width, int height)
     : width_{ width }
-    , height_{ height } {
-    data_.resize(height);
-    for (int y = 0; y < height; ++y) {
-        data_[y].resize(width);
-    }
+    , height_{ height } {}
 
+WithError<std::shared_ptr<Window>>
+NewWindow(int width, int height, PixelFormat format) {
     FrameBufferConfig config{};
     config.frame_buffer = nullptr;
     config.horizontal_resolution = width;
     config.vertical_resolution = height;
-    config.pixel_format = shadow_format;
-
-    if (auto err = shadow_buffer_.Initialize(config)) {
-        Log(kError,
-            "failed to initialize shadow buffer: %s at %s:%d\n",
-            err.Name(),
-            err.File(),
-            err.Line());
+    config.pixel_format = format;
+
+    std::shared_ptr<Window> window{ new Window{ width, height } };
+    if (auto err = window->buffer_.Initialize(config)) {
+        return { nullptr, err };
     }
+    return { window, MAKE_ERROR(Error::kSuccess) };
 }
 
 void
-Window::DrawTo(FrameBuffer& dst, Vector2D<int> pos, const Rectangle<int>& area) {
-    if (!transparent_color_) {
-        Rectangle<int> window_area{ pos, Size() };
-        Rectangle<int> intersection = area & window_area;
-        dst.Copy(intersection.pos, shadow_buffer_, { intersection.pos - pos, intersection.size });
+Window::DrawTo(FrameBuffer& dst,
+               Vector2D<int> pos,
+               const Rectangle<int>& area,
+               const Blitter& blitter) {
+    Rectangle<int> window_area{ pos, Size() };
+    Rectangle<int> intersection = area & window_area;
+    if (intersection.size.x <= 0 || intersection.size.y <= 0) {
         return;
     }
+    if (transparent_key_ && opaque_runs_dirty_) {
+        BuildRunMask(buffer_, *transparent_key_, opaque_runs_);
+        opaque_runs_dirty_ = false;
+    }
 
-    const auto tc = transparent_color_.value();
-    auto& writer = dst.Writer();
-    for (int y = std::max(0, 0 - pos.y); y < std::min(Height(), writer.Height() - pos.y); ++y) {
-        for (int x = std::max(0, 0 - pos.x); x < std::min(Width(), writer.Width() - pos.x); ++x) {
-            const auto c = At(Vector2D<int>{ x, y });
-            if (c != tc) {
-                writer.Write(pos + Vector2D<int>{ x, y }, c);
-            }
+    // 表示上の行をバッファ上の行に直し、バッファの下端で折り返す部分は2回目の転送にする
+    const auto display_pos = intersection.pos - pos;
+    const int buffer_y = (display_pos.y + scroll_origin_) % height_;
+    const int first_height = std::min(intersection.size.y, height_ - buffer_y);
+    const Rectangle<int> slices[2] = {
+        { { display_pos.x, buffer_y }, { intersection.size.x, first_height } },
+        { { display_pos.x, 0 }, { intersection.size.x, intersection.size.y - first_height } },
+    };
+
+    auto dst_pos = intersection.pos;
+    for (const auto& src_area : slices) {
+        if (src_area.size.y <= 0) {
+            break;
+        }
+        if (transparent_key_) {
+            blitter.copy_masked(dst, dst_pos, buffer_, src_area, opaque_runs_);
+        } else {
+            blitter.copy(dst, dst_pos, buffer_, src_area);
         }
+        dst_pos.y += src_area.size.y;
     }
 }
 
 void
 Window::SetTransparentColor(std::optional<PixelColor> c) {
-    transparent_color_ = c;
+    if (c) {
+        transparent_key_ = ToNativePixel(buffer_.Config().pixel_format, *c);
+    } else {
+        transparent_key_ = std::nullopt;
+    }
+    AddDamage({ { 0, 0 }, Size() });
+}
+
+bool
+Window::IsOpaque() const {
+    return !transparent_key_;
 }
 
 Window::WindowWriter*
@@ -56,15 +80,33 @@ Window::Writer() {
     return &writer_;
 }
 
-const PixelColor&
+PixelColor
 Window::At(Vector2D<int> pos) const {
-    return data_[pos.y][pos.x];
+    return buffer_.Writer().At(pos);
 }
 
 void
 Window::Write(Vector2D<int> pos, PixelColor c) {
-    data_[pos.y][pos.x] = c;
-    shadow_buffer_.Writer().Write(pos, c);
+    buffer_.Writer().Write(pos, c);
+    AddDamage({ pos, { 1, 1 } });
+}
+
+void
+Window::FillRect(Vector2D<int> pos, Vector2D<int> size, const PixelColor& c) {
+    buffer_.Writer().FillRect(pos, size, c);
+    AddDamage({ pos, size });
+}
+
+void
+Window::WriteMaskedRow(Vector2D<int> pos, uint8_t bits, const PixelColor& c) {
+    buffer_.Writer().WriteMaskedRow(pos, bits, c);
+    AddDamage({ pos, { 8, 1 } });
+}
+
+void
+Window::WriteGlyph(Vector2D<int> pos, const NativeGlyph& glyph) {
+    buffer_.Writer().WriteGlyph(pos, glyph);
+    AddDamage({ pos, { NativeGlyph::kWidth, NativeGlyph::kHeight } });
 }
 
 int
@@ -82,9 +124,64 @@ Window::Size() const {
     return { width_, height_ };
 }
 
+PixelFormat
+Window::Format() const {
+    return buffer_.Config().pixel_format;
+}
+
 void
 Window::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
-    shadow_buffer_.Move(dst_pos, src);
+    buffer_.Move(dst_pos, src);
+    AddDamage({ dst_pos, src.size });
+}
+
+void
+Window::SetScrollOrigin(int y) {
+    scroll_origin_ = ((y % height_) + height_) % height_;
+    // バッファの内容は変わらなくても、表示上はすべての行が別の行の内容に入れ替わるので、
+    // 画面へは全体を反映し直す必要がある 書き換えた行だけを記録すると、他の行が古い位置のまま残る
+    // 何度スクロールしても反映はフレームごとの Flush で1回にまとまる
+    damage_ = { { 0, 0 }, Size() };
+}
+
+int
+Window::ScrollOrigin() const {
+    return scroll_origin_;
+}
+
+Rectangle<int>
+Window::TakeDamage() {
+    const auto damage = damage_;
+    damage_ = {};
+    return damage;
+}
+
+bool
+Window::HasDamage() const {
+    return damage_.size.x > 0 && damage_.size.y > 0;
+}
+
+void
+Window::AddDamage(const Rectangle<int>& area) {
+    opaque_runs_dirty_ = true;
+    if (scroll_origin_ == 0) {
+        damage_ = damage_ | area;
+        return;
+    }
+
+    // 表示上で折り返す範囲は、上下に分かれた2つの矩形を合成する
+    const int top = DisplayRow(area.pos.y);
+    const int first_height = std::min(area.size.y, height_ - top);
+    damage_ = damage_ | Rectangle<int>{ { area.pos.x, top }, { area.size.x, first_height } };
+    if (first_height < area.size.y) {
+        damage_ = damage_ | Rectangle<int>{ { area.pos.x, 0 },
+                                            { area.size.x, area.size.y - first_height } };
+    }
+}
+
+int
+Window::DisplayRow(int y) const {
+    return (y - scroll_origin_ + height_) % height_;
 }
 
 namespace {
@@ -8,8 +8,8 @@
 
 #include "frame_buffer.hpp"
 #include "graphics.hpp"
+#include <memory>
 #include <optional>
-#include <vector>
 
 /**
  * @brief Windowクラスはグラフィックの表示領域を表す
@@ -27,6 +27,26 @@ class Window {
         virtual void Write(Vector2D<int> pos, const PixelColor& c) override {
             window_.Write(pos, c);
         }
+        /** @brief 指定された位置から横方向に width ピクセルを塗る */
+        virtual void FillHLine(Vector2D<int> pos, int width, const PixelColor& c) override {
+            window_.FillRect(pos, { width, 1 }, c);
+        }
+        /** @brief 指定された矩形を塗る */
+        virtual void FillRect(Vector2D<int> pos, Vector2D<int> size, const PixelColor& c) override {
+            window_.FillRect(pos, size, c);
+        }
+        /** @brief 指定された位置から横方向の 8 ピクセルのうち bits の立っている箇所を塗る */
+        virtual void WriteMaskedRow(Vector2D<int> pos, uint8_t bits, const PixelColor& c) override {
+            window_.WriteMaskedRow(pos, bits, c);
+        }
+        /** @brief 指定された位置に展開済みの文字を書く */
+        virtual void WriteGlyph(Vector2D<int> pos, const NativeGlyph& glyph) override {
+            window_.WriteGlyph(pos, glyph);
+        }
+        /** @brief 関連付けられたWindowのピクセル形式を返す */
+        virtual std::optional<PixelFormat> NativeFormat() const override {
+            return window_.Format();
+        }
         /** @brief Widthは関連付けられたWindowの横幅をピクセル単位で返す */
         virtual int Width() const override { return window_.Width(); }
         /** @brief Heightは関連付けられたWindowの高さをピクセル単位で返す */
@@ -36,8 +56,6 @@ class Window {
         Window& window_;
     };
 
-    /** @brief 指定されたピクセル数の平面描画領域を作成する */
-    Window(int width, int height, PixelFormat shadow_format);
     ~Window() = default;
     Window(const Window& rhs) = delete;
     Window& operator=(const Window& rhs) = delete;
@@ -45,20 +63,36 @@ class Window {
     /**
      * @brief 与えられたFrameBufferにこのウィンドウの表示領域を描画する
      *
-     * @param dst   描画先
-     * @param pos   dst の左上を基準としたウィンドウの位置
-     * @param area  dst の左上を基準とした描画対象範囲
+     * @param dst      描画先
+     * @param pos      dst の左上を基準としたウィンドウの位置
+     * @param area     dst の左上を基準とした描画対象範囲
+     * @param blitter  dst のピクセル形式に合わせて選ばれた転送処理
      */
-    void DrawTo(FrameBuffer& dst, Vector2D<int> pos, const Rectangle<int>& area);
+    void DrawTo(FrameBuffer& dst,
+                Vector2D<int> pos,
+                const Rectangle<int>& area,
+                const Blitter& blitter);
     /** @brief 透過色を設定する */
     void SetTransparentColor(std::optional<PixelColor> c);
+    /** @brief 透過色が設定されておらず、描画範囲を完全に覆い隠すなら true を返す */
+    bool IsOpaque() const;
     /** @brief このインスタンスに紐づいたWindowWriterを取得する */
     WindowWriter* Writer();
 
     /** @brief 指定した位置のピクセルを返す */
-    const PixelColor& At(Vector2D<int> pos) const;
+    PixelColor At(Vector2D<int> pos) const;
     /** @brief 指定した位置にピクセルを書き込む。 */
     void Write(Vector2D<int> pos, PixelColor c);
+    /** @brief 指定した矩形を1色で塗りつぶす */
+    void FillRect(Vector2D<int> pos, Vector2D<int> size, const PixelColor& c);
+    /**
+     * @brief 指定した位置から横方向の 8 ピクセルのうち、bits の立っているピクセルに書き込む
+     *
+     * bits の最上位ビットが pos のピクセルに対応する
+     */
+    void WriteMaskedRow(Vector2D<int> pos, uint8_t bits, const PixelColor& c);
+    /** @brief 指定した位置を左上として展開済みの文字を書き込む */
+    void WriteGlyph(Vector2D<int> pos, const NativeGlyph& glyph);
 
     /** @brief 平面描画領域の横幅をピクセル単位で返す */
     int Width() const;
@@ -66,6 +100,8 @@ class Window {
     int Height() const;
     /** @brief 平面描画領域のサイズをピクセル単位で返す */
     Vector2D<int> Size() const;
+    /** @brief 描画内容を保持するバッファのピクセル形式を返す */
+    PixelFormat Format() const;
 
     /**
      * @brief このウィンドウの平面描画領域内で、矩形領域を移動する。
@@ -76,14 +112,69 @@ class Window {
      */
     void Move(Vector2D<int> dst_pos, const Rectangle<int>& src);
 
+    /**
+     * @brief バッファの y 行目がウィンドウの先頭に表示されるよう、表示を縦方向に回転させる
+     *
+     * 描画は常にバッファ上の座標で行い、DrawTo がバッファの下端と上端をつないで
+     * 2つに分けて転送する 行単位のリングバッファとして使えば、全体をコピーせずにスクロールできる
+     */
+    void SetScrollOrigin(int y);
+    /** @brief ウィンドウの先頭に表示しているバッファの行を返す */
+    int ScrollOrigin() const;
+
+    /**
+     * @brief 前回 TakeDamage を呼んでから書き換えられた範囲を返し、記録を消去する
+     *
+     * 書き込みのたびに書き換えた範囲を1つの矩形に合成して記録している
+     * 戻り値はウィンドウの左上を原点とした座標で、書き換えがなければ大きさ0の矩形となる
+     */
+    Rectangle<int> TakeDamage();
+    /** @brief 前回 TakeDamage を呼んでから書き換えられた範囲があれば true を返す */
+    bool HasDamage() const;
+
   private:
+    friend WithError<std::shared_ptr<Window>> NewWindow(int width, int height, PixelFormat format);
+
+    /** @brief バッファは確保しないので、NewWindow からだけ作る */
+    Window(int width, int height);
+
     int width_, height_;
-    std::vector<std::vector<PixelColor>> data_{};
     WindowWriter writer_{ *this };
-    std::optional<PixelColor> transparent_color_{ std::nullopt };
+    /** @brief 透過色を buffer_ のピクセル形式の 32 ビット値で表したもの */
+    std::optional<uint32_t> transparent_key_{ std::nullopt };
+
+    /** @brief 描画内容を保持するバッファ */
+    FrameBuffer buffer_{};
+    /** @brief 画面へ反映していない書き換え範囲 */
+    Rectangle<int> damage_{};
+    /** @brief 透過色を持つとき、不透明なピクセルの範囲を行ごとに求めたもの */
+    RunMask opaque_runs_{};
+    /** @brief 内容が書き換えられ、opaque_runs_ を作り直す必要があれば true */
+    bool opaque_runs_dirty_{ true };
+    /** @brief ウィンドウの先頭に表示するバッファの行 */
+    int scroll_origin_{ 0 };
+
+    /**
+     * @brief 書き換えた範囲を damage_ に加え、opaque_runs_ を作り直すよう記録する
+     *
+     * @param area  バッファ上の座標で表した範囲 表示上の座標に直して記録する
+     */
+    void AddDamage(const Rectangle<int>& area);
+    /** @brief バッファ上の y 行目が表示される行を返す */
+    int DisplayRow(int y) const;
 
-    FrameBuffer shadow_buffer_{};
 };
 
+/**
+ * @brief 指定されたピクセル数の平面描画領域を作成する
+ *
+ * 描画内容は format 形式の連続した 1 枚のバッファにだけ保持する
+ * format には描画先の画面と同じ形式を指定する
+ *
+ * @return バッファを確保できなければエラーと nullptr
+ */
+WithError<std::shared_ptr<Window>>
+NewWindow(int width, int height, PixelFormat format);
+
 void
 DrawWindow(PixelWriter& writer, const char* title);
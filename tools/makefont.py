@@ -33,11 +33,62 @@ def compile(src: str) -> bytes:
     return b''.join(result)
 
 
+# 1 バイトの各ビットを、左端 (最上位ビット) から順に 8 レーンの 32 ビットマスクへ展開した表
+def lane_masks() -> list:
+    return [[(0xffffffff if (byte << lane) & 0x80 else 0) for lane in range(8)]
+            for byte in range(256)]
+
+
+# 各グリフで点のある列の範囲 [begin, end) を求める 点が無ければ (0, 0)
+def column_extents(font: bytes) -> list:
+    extents = []
+    for i in range(0, len(font), 16):
+        bits = functools.reduce(lambda a, b: a | b, font[i:i + 16], 0)
+        if bits == 0:
+            extents.append((0, 0))
+            continue
+        columns = [x for x in range(8) if (bits << x) & 0x80]
+        extents.append((columns[0], columns[-1] + 1))
+    return extents
+
+
+# コンパイル済みのフォントデータから展開済みの表を持つ C++ ヘッダを生成する
+def make_header(font: bytes) -> str:
+    lines = [
+        '// tools/makefont.py が生成したファイル 直接編集しないこと',
+        '',
+        '#pragma once',
+        '',
+        '#include <cstdint>',
+        '',
+        '// kFontLaneMasks[b][x] はバイト b の左から x 番目のビットが立っていれば 0xffffffff',
+        'constexpr uint32_t kFontLaneMasks[256][8] = {',
+    ]
+    for masks in lane_masks():
+        lines.append('    {' + ', '.join('0x{:08x}u'.format(m) for m in masks) + '},')
+    lines += [
+        '};',
+        '',
+        '// グリフのうち点のある列の範囲 [begin, end)',
+        'struct GlyphExtent {',
+        '    uint8_t begin, end;',
+        '};',
+        '',
+        'constexpr int kNumFontGlyphs = {};'.format(len(font) // 16),
+        'constexpr GlyphExtent kGlyphExtents[kNumFontGlyphs] = {',
+    ]
+    for begin, end in column_extents(font):
+        lines.append('    {{{}, {}}},'.format(begin, end))
+    lines += ['};', '']
+    return '\n'.join(lines)
+
+
 def main():
     # 引数を解析する
     parser = argparse.ArgumentParser()
     parser.add_argument('font', help='path to a font file')
     parser.add_argument('-o', help='path to an output file', default='font.out')
+    parser.add_argument('--header', help='path to a C++ header with expanded tables')
     ns = parser.parse_args()
 
     # 出力ファイルとフォントファイルを開く
@@ -45,7 +96,13 @@ def main():
         # フォントファイルからデータを読み込む
         src = font.read()
         # フォントデータをバイト列にコンパイルして出力ファイルに書き込む
-        out.write(compile(src))
+        data = compile(src)
+        out.write(data)
+
+    # 展開済みの表をヘッダとして書き出す
+    if ns.header:
+        with open(ns.header, 'w') as header:
+            header.write(make_header(data))
 
 
 if __name__ == '__main__':
@@ -0,0 +1,74 @@
+#!/usr/bin/python3
+
+import argparse
+import json
+import sys
+
+
+# DumpTrace の出力を読み、イベント名の表とイベントの列を返す
+# 入力にはログなど他の行が混ざっていてもよい
+def parse(lines) -> tuple:
+    names = {}
+    records = []
+    for line in lines:
+        fields = line.split()
+        if len(fields) == 3 and fields[0] == 'E':
+            names[int(fields[1])] = fields[2]
+        elif len(fields) == 6 and fields[0] == 'R':
+            cpu, event = int(fields[1]), int(fields[3])
+            tsc, arg0, arg1 = (int(x, 16) for x in (fields[2], fields[4], fields[5]))
+            records.append((tsc, cpu, event, arg0, arg1))
+    records.sort()
+    return names, records
+
+
+# イベントの列を Chrome/Perfetto が読める Trace Event Format に変換する
+# 名前が _begin/_end で終わるイベントは区間、それ以外は瞬間のイベントとする
+def convert(names: dict, records: list, tsc_mhz: float) -> dict:
+    events = []
+    base = records[0][0] if records else 0
+    for tsc, cpu, event, arg0, arg1 in records:
+        name = names.get(event, 'event_{}'.format(event))
+        if name.endswith('_begin'):
+            name, phase = name[:-len('_begin')], 'B'
+        elif name.endswith('_end'):
+            name, phase = name[:-len('_end')], 'E'
+        else:
+            phase = 'i'
+        e = {
+            'name': name,
+            'ph': phase,
+            'ts': (tsc - base) / tsc_mhz,
+            'pid': 0,
+            'tid': cpu,
+            'args': {'arg0': arg0, 'arg1': arg1},
+        }
+        if phase == 'i':
+            e['s'] = 't'
+        events.append(e)
+    return {'traceEvents': events, 'displayTimeUnit': 'ns'}
+
+
+def main():
+    # 引数を解析する
+    parser = argparse.ArgumentParser()
+    parser.add_argument('dump', nargs='?', help='path to a DumpTrace output (default: stdin)')
+    parser.add_argument('-o', help='path to an output file (default: stdout)')
+    parser.add_argument('--tsc-mhz', type=float, default=1000.0,
+                        help='TSC frequency used to convert timestamps to microseconds')
+    ns = parser.parse_args()
+
+    # ダンプを読み込んで変換する
+    src = open(ns.dump, errors='replace') if ns.dump else sys.stdin
+    with src:
+        names, records = parse(src)
+    trace = convert(names, records, ns.tsc_mhz)
+
+    # 変換結果を書き出す
+    out = open(ns.o, 'w') if ns.o else sys.stdout
+    with out:
+        json.dump(trace, out)
+
+
+if __name__ == '__main__':
+    main()